@@ -3,109 +3,659 @@
 #if !defined(ANNEALER_H)
 #define ANNEALER_H
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <assert.h>
 #include <math.h>
+#include <stdio.h>
 
+#include "CancelToken.h"
+#include "Checkpoint.h"
+#include "CoolingSchedule.h"
 #include "IOptimizer.h"
+#include "Observer.h"
+#include "Profile.h"
+#include "Random.h"
+#include "Speculator.h"
 
 
 
+//******************************************************************************
+// Annealer
+//
+// Simulated annealing. MoveMgrType may be IMoveMgr, in which case every call
+// on the move manager is virtual, or a concrete move manager class; see
+// IsMoveMgr. RandType is the random number generator; see Random.h for the
+// interface it needs.
+//******************************************************************************
 template<class MoveType,
          class CostType    = double,
-         class MoveMgrType = IMoveMgr<MoveType, CostType> >
+         class MoveMgrType = IMoveMgr<MoveType, CostType>,
+         class RandType    = Random>
 class Annealer : public IOptimizer<MoveType, CostType, MoveMgrType> {
+    static_assert(IsMoveMgr<MoveMgrType, MoveType, CostType>::value,
+                  "MoveMgrType must provide the IMoveMgr methods");
+
   public:
+    Annealer(unsigned int seed = 5241999);
+
     virtual void            optimize(MoveMgrType* moveMgr);
 
+    // Progress is written to stdout/stderr by a ConsoleObserver unless this
+    // is turned off, which you'll want when several annealers are running at
+    // once, or another observer is set.
+    void                    setVerbose(bool verbose);
+
+    // Report progress to the given observer, which the caller continues to
+    // own, instead of the console.
+    void                    setObserver(IObserver* observer);
+
+    // In batched mode, each equilibrium generates blocks of this many moves
+    // and evaluates them with a single call to IMoveMgr::proposeMoves, which
+    // the move manager may vectorize. The moves are then considered in order,
+    // and the rest of the block is discarded once one is accepted, since
+    // their costs are stale. That keeps the Markov chain the same as in the
+    // unbatched mode, which is a batch size of 1 (the default).
+    void                    setBatchSize(unsigned int batchSize);
+
+    // Use the given cooling schedule, which the caller continues to own, or
+    // the default GeometricSchedule if it's 0.
+    void                    setSchedule(ICoolingSchedule* schedule);
+
+    // How the starting temperature is found. BinarySearchTemp, the default,
+    // searches for the temperature at which half of all moves are accepted,
+    // running 100 * problem size moves at each of a couple of dozen probe
+    // temperatures. SampledTemp samples the deltas of uphill moves from the
+    // starting state once, and solves for the temperature at which
+    // acceptRatio of them would be accepted using Ben-Ameur's iteration.
+    enum StartTempMethod {
+        BinarySearchTemp,
+        SampledTemp
+    };
+
+    void                    setStartTempMethod(StartTempMethod method,
+                                               double          acceptRatio = 0.8);
+
+    // Start at this temperature instead of finding one, e.g. to re-optimize
+    // a good solution without heating it back up. 0, the default, finds it
+    // with the StartTempMethod.
+    void                    setStartTemp(double temp);
+
+    // Every interval equilibria, write a checkpoint of the anneal and of the
+    // move manager's state (see IMoveMgr::saveState) to filename. The file
+    // is written under a temporary name and then renamed, so a crash leaves
+    // the last complete checkpoint. An interval of 0, the default, turns
+    // checkpoints off.
+    void                    setCheckpoint(const std::string& filename,
+                                          int                interval);
+
+    // Load a checkpoint into this annealer and moveMgr, which must be set
+    // up for the same problem as the ones that wrote it. The next call to
+    // optimize(moveMgr) then carries on where the checkpointed run left off,
+    // rather than starting afresh. On failure, returns false and describes
+    // the problem in error.
+    bool                    restore(const std::string& filename,
+                                    MoveMgrType*       moveMgr,
+                                    std::string&       error);
+
+    // Finish within this many seconds of the call to optimize(), or 0 (the
+    // default) for no limit. The cooling is sped up as needed so that the
+    // temperature falls to endTempRatio times the temperature the run starts
+    // at by the deadline, the rate being worked out after each equilibrium
+    // from the time left and the time equilibria have been taking. A
+    // schedule that would cool faster anyway is left alone. If the deadline
+    // comes first, the run stops within a few thousand moves.
+    void                    setTimeBudget(double seconds,
+                                          double endTempRatio = 0.0001);
+
+    // Stop as soon as possible once this token, which the caller continues
+    // to own, is cancelled, or 0 (the default) for none.
+    void                    setCancelToken(const CancelToken* token);
+
+    // Hand back the best state seen at the end of any equilibrium rather
+    // than wherever the Markov chain was when the run ended. That's what
+    // you want when a run may be cut short by a deadline or cancellation,
+    // at which point the chain could be anywhere. The best state is kept
+    // in a clone of the move manager, so it must support clone() and
+    // copyState().
+    void                    setKeepBest(bool keepBest);
+
+    // Propose moves speculatively on this many threads in the equilibria
+    // where the last equilibrium accepted too few moves for the chain to
+    // keep them busy otherwise; see Speculator. The chain is the same
+    // Markov chain as without, only its proposals are worked out ahead in
+    // parallel, and the batch size is ignored while speculating. 1, the
+    // default, turns this off, and 0 means one thread per hardware thread.
+    // The move manager must support clone(), copyState() and seed().
+    void                    setSpeculation(unsigned int numThreads);
+
+    // Don't consider stopping on convergence until the cost is this
+    // fraction below where the run started (default 0.1), since the test
+    // often false-alarms at the very beginning otherwise. A run warm-started
+    // from a good solution at a low temperature may never improve that
+    // much, and should set this to 0.
+    void                    setRequiredImprovement(double fraction);
+
   private:
+    enum {
+        // Check the deadline and the cancel token every this many moves
+        stopCheckKnob       = 1024,
+
+        // Don't consider stopping until after this many equilibria
+        minEquilsKnob       = 5,
+
+        // Regardless of the convergence criterion, stop if this many
+        // equilibria go by without seeing a new best cost. This could
+        // probably be lower.
+        equilsSinceBestKnob = 100,
+
+        // Speculate only when each thread's share of the moves expected
+        // before the next acceptance is at least this many, which is enough
+        // to pay for the handoff between threads
+        minSpeculateKnob    = 16,
+
+        // and give each thread at most this many moves per round
+        maxSpeculateKnob    = 256
+    };
+
+    // Where an anneal is between equilibria; this is what a checkpoint saves.
+    struct State {
+        double              temp;           // of the next equilibrium
+        int                 equils;         // done so far
+        int                 equilsSinceBest;
+        CostType            best;
+        CostType            first;          // the cost before annealing
+        double              tempHistory[minEquilsKnob];
+        CostType            costHistory[minEquilsKnob];
+    };
+
+    // Running totals over an equilibrium.
+    struct Totals {
+        double              cost;
+        double              costSq;
+        double              deltaCost;
+        double              deltaCostSq;
+        int                 attempts;
+        int                 acceptances;
+    };
+
+    // The Metropolis test accepts an uphill move when deltaCost < -temp * log(u)
+    // for u uniform in (0, 1]. Rather than take a log per move, setTemp()
+    // tabulates that bound at the edges of acceptTableSize equal buckets of u,
+    // and accept() looks up the bucket from the top bits of a random number.
+    // Only when deltaCost falls between the bounds of its bucket, about once
+    // per acceptTableSize moves, does it compute the log exactly, so the test
+    // is exact without a transcendental on the hot path.
+    enum {
+        acceptTableBits = 10,
+        acceptTableSize = 1 << acceptTableBits
+    };
+
     double                  measureTemp();
-    void                    equilibrate(const double temp,
-                                        double&      meanCost,
-                                        double&      costStdDev,
-                                        double&      deltaCostStdDev,
-                                        double&      acceptRatio);
+    double                  sampleTemp();
+    void                    setTemp(const double temp);
+    bool                    accept(const CostType deltaCost);
+    void                    equilibrate(const double      temp,
+                                        EquilibriumStats& stats);
+    bool                    attempt(const MoveType* move,
+                                    const CostType  deltaCost,
+                                    CostType&       curr_cost,
+                                    Totals&         totals);
     double                  project(const int       n,
                                     const double*   x,
                                     const CostType* y) const;
     void                    seedRand(unsigned int seed);
     double                  getRand();
+    IObserver*              observer();
+    bool                    saveCheckpoint(std::string& error) const;
+    bool                    stopRequested();
 
     MoveMgrType*            _moveMgr;
+    unsigned int            _seed;
+    bool                    _verbose;
+    IObserver*              _observer;
+    ConsoleObserver         _console;
+    RandType                _rand;
+    double                  _temp;
+    double                  _threshold[acceptTableSize];    // -_temp * log of each bucket's upper edge
+    unsigned int            _batchSize;
+    std::vector<MoveType>   _batch;
+    std::vector<CostType>   _batchDeltas;
+    ICoolingSchedule*       _schedule;
+    StartTempMethod         _startTempMethod;
+    double                  _startAcceptRatio;
+    GeometricSchedule       _geometric;
+    double                  _startTemp;
+    State                   _state;
+    bool                    _resume;                        // _state was restored, so optimize() carries on
+    std::string             _checkpointFile;
+    int                     _checkpointInterval;
+    double                  _timeBudget;
+    double                  _endTempRatio;
+    std::chrono::steady_clock::time_point _deadline;
+    const CancelToken*      _cancel;
+    bool                    _keepBest;
+    bool                    _stopped;                       // by the deadline or the cancel token
+    unsigned int            _speculationThreads;
+    std::unique_ptr<Speculator<MoveType, CostType, MoveMgrType> > _speculator;     // while optimize() runs
+    double                  _acceptRatio;                   // of the last equilibrium
+    double                  _requiredImprovement;
+#if defined(OPTIMIZER_PROFILE)
+    PhaseProfile            _profile;
+#endif
+
+    // ParallelTempering drives one Annealer per replica, one equilibrium at a time.
+    template<class, class, class> friend class ParallelTempering;
 };
 
 
 
-// This is the main routine.
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+Annealer<MoveType, CostType, MoveMgrType, RandType>::Annealer(unsigned int seed)
+:   _moveMgr(0),
+    _seed(seed),
+    _verbose(true),
+    _observer(0),
+    _temp(0.0),
+    _batchSize(1),
+    _schedule(0),
+    _startTempMethod(BinarySearchTemp),
+    _startAcceptRatio(0.8),
+    _startTemp(0.0),
+    _resume(false),
+    _checkpointInterval(0),
+    _timeBudget(0.0),
+    _endTempRatio(0.0001),
+    _cancel(0),
+    _keepBest(false),
+    _stopped(false),
+    _speculationThreads(1),
+    _acceptRatio(1.0),
+    _requiredImprovement(0.1)
+{
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setObserver(IObserver* observer)
+{
+    _observer = observer;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setBatchSize(unsigned int batchSize)
+{
+    _batchSize = std::max(batchSize, 1u);
+    _batch.resize(_batchSize);
+    _batchDeltas.resize(_batchSize);
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setSchedule(ICoolingSchedule* schedule)
+{
+    _schedule = schedule;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 void
-Annealer<MoveType, CostType, MoveMgrType>::optimize(MoveMgrType* moveMgr)
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setStartTempMethod(StartTempMethod method,
+                                                                        double          acceptRatio)
 {
-    // Don't consider stopping until after this many equilibria
-    const int       minEquilsKnob           = 5;
+    assert(acceptRatio > 0.0 && acceptRatio < 1.0);
 
-    // Don't consider stopping due to convergence unless we've made this much improvement
-    // over the initial cost.
-    const double    requiredImprovementKnob = 0.1;
+    _startTempMethod = method;
+    _startAcceptRatio = acceptRatio;
+}
 
-    // Regardless of the convergence criterion, stop if this many equilibria go by
-    // without seeing a new best cost. This could probably be lower.
-    const int       equilsSinceBestKnob     = 100;
 
-    seedRand(5241999);
+
+// This is the main routine.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::optimize(MoveMgrType* moveMgr)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
     _moveMgr = moveMgr;
+    _deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(_timeBudget));
+    _stopped = false;
+
+    IObserver* const observer = this->observer();
+    EquilibriumRecord record = EquilibriumRecord();
+    record.seed = _seed;
+
+    // A restored run already has its state, random number generator included.
+    State& state = _state;
+    if (!_resume) {
+        seedRand(_seed);
+
+        if (_startTemp > 0.0) {
+            state.temp = _startTemp;
+        } else {
+            state.temp = _startTempMethod == SampledTemp ? sampleTemp() : measureTemp();
+        }
+        state.equils = 0;
+        state.equilsSinceBest = equilsSinceBestKnob;
+        state.best = _moveMgr->getScore();
+        state.first = state.best;
+    }
+    _resume = false;
 
-    double          temp    = measureTemp();
-    CostType        best    = _moveMgr->getScore();
-    const CostType  first   = best;
-    double          tempHistory[minEquilsKnob];
-    CostType        costHistory[minEquilsKnob];
+#if defined(OPTIMIZER_PROFILE)
+    // Only now, so that the moves tried in choosing the start temperature,
+    // which aren't timed, don't count as generate retries either.
+    _profile.reset();
+#endif
+
+    std::unique_ptr<MoveMgrType> bestState;
+    if (_keepBest) {
+        bestState.reset(static_cast<MoveMgrType*>(_moveMgr->clone()));
+        assert(bestState != 0);
+    }
+
+    if (_speculationThreads != 1) {
+        _speculator.reset(new Speculator<MoveType, CostType, MoveMgrType>(_moveMgr, _speculationThreads, maxSpeculateKnob));
+#if defined(OPTIMIZER_PROFILE)
+        _speculator->setProfile(&_profile);
+#endif
+    }
+    _acceptRatio = 1.0;
+
+    // For pacing the cooling to fit the time budget.
+    const std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+    const double endTemp = state.temp * _endTempRatio;
+    int          equilsThisRun = 0;
 
     // Repeat until we exceed equilsSinceBestKnob equilibria with no new best score.
-    // The convergence stop criterion will break out of this loop.
-    int equilsSinceBest = equilsSinceBestKnob;
-    for (int equils = 0; best > 0 && equilsSinceBest-- > 0; ++equils) {
+    // The convergence stop criterion will break out of this loop, as will
+    // running out of time or being cancelled.
+    while (state.best > 0 && state.equilsSinceBest > 0 && !_stopped && !stopRequested()) {
+        --state.equilsSinceBest;
+        const int    equils = state.equils;
+        const double temp   = state.temp;
 
         // Do an equilibrium.
-        double meanCost;
-        double costStdDev;
-        double deltaCostStdDev;
-        double acceptRatio;
-        equilibrate(temp, meanCost, costStdDev, deltaCostStdDev, acceptRatio);
+        const std::chrono::steady_clock::time_point equilStart = std::chrono::steady_clock::now();
+        EquilibriumStats stats;
+        equilibrate(temp, stats);
 
         // If we have a new best score, store it and reset equilsSinceBest
         const CostType c = _moveMgr->getScore();
-        if (c < best) {
-            best = c;
-            equilsSinceBest = equilsSinceBestKnob;
+        if (c < state.best) {
+            state.best = c;
+            state.equilsSinceBest = equilsSinceBestKnob;
+            if (bestState) {
+                bestState->copyState(_moveMgr);
+            }
         }
 
-        std::cout << "t=" << temp << " c=" << _moveMgr->getScore() << " ";
-
         // Once we get past the minimum number of equilibria, check for stop criterion.
         // This is done by fitting a line through the last several (temp,cost) points.
         // When the intercept of that line is essentially equal to the current score, stop.
         // We also require a certain amount of improvement to have happened first, since
         // this stop criterion often false-alarms at the very beginning otherwise.
         const int ix = equils % minEquilsKnob;
-        costHistory[ix] = c;
-        tempHistory[ix] = temp;
+        state.costHistory[ix] = c;
+        state.tempHistory[ix] = temp;
+        bool   converged = false;
+        double intercept = 0.0;
         if (equils > minEquilsKnob) {
-            const double intercept = project(minEquilsKnob, tempHistory, costHistory);
-            std::cout << "s=" << intercept << "\n";
-            if (abs(intercept - c) < 0.00001 && c < first * (1.0 - requiredImprovementKnob)) {
-                break;
-            }
-        } else {
-            std::cout << "\n";
+            intercept = project(minEquilsKnob, state.tempHistory, state.costHistory);
+            converged = abs(intercept - c) < 0.00001 && c < state.first * (1.0 - _requiredImprovement);
+        }
+
+        if (observer != 0) {
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            record.equilibrium = equils;
+            record.temp = temp;
+            record.cost = double(c);
+            record.bestCost = double(state.best);
+            record.meanCost = stats.meanCost;
+            record.costStdDev = stats.costStdDev;
+            record.acceptRatio = stats.acceptRatio;
+            record.attempts = stats.attempts;
+            record.movesPerSec = stats.attempts / std::chrono::duration<double>(now - equilStart).count();
+            record.seconds = std::chrono::duration<double>(now - start).count();
+            record.projected = equils > minEquilsKnob;
+            record.intercept = intercept;
+            observer->equilibrium(record);
+        }
+        if (converged || _stopped) {
+            break;
+        }
+
+        state.temp = (_schedule != 0 ? _schedule : &_geometric)->nextTemp(temp, stats);
+        ++state.equils;
+        ++equilsThisRun;
+
+        // If the schedule would still be hot at the deadline, cool at the
+        // geometric rate that reaches endTemp in the equilibria left.
+        if (_timeBudget > 0.0 && temp > endTemp) {
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            const double perEquil   = std::chrono::duration<double>(now - loopStart).count() / equilsThisRun;
+            const double remaining  = std::chrono::duration<double>(_deadline - now).count();
+            const double equilsLeft = std::max(remaining / perEquil, 1.0);
+            state.temp = std::min(state.temp, temp * pow(endTemp / temp, 1.0 / equilsLeft));
+        }
+
+        std::string error;
+        if (_checkpointInterval > 0 && state.equils % _checkpointInterval == 0 && !saveCheckpoint(error)) {
+            std::cerr << error << std::endl;
+        }
+    }
+
+    _speculator.reset();
+
+    if (bestState && bestState->getScore() < _moveMgr->getScore()) {
+        _moveMgr->copyState(bestState.get());
+    }
+
+    if (observer != 0) {
+        record.temp = state.temp;
+        record.cost = double(_moveMgr->getScore());
+        record.bestCost = double(state.best);
+        record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        observer->finished(record);
+    }
+
+#if defined(OPTIMIZER_PROFILE)
+    _profile.dump(std::cerr);
+#endif
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setStartTemp(double temp)
+{
+    _startTemp = temp;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setTimeBudget(double seconds,
+                                                                   double endTempRatio)
+{
+    assert(endTempRatio > 0.0 && endTempRatio < 1.0);
+
+    _timeBudget = std::max(seconds, 0.0);
+    _endTempRatio = endTempRatio;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setCancelToken(const CancelToken* token)
+{
+    _cancel = token;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setKeepBest(bool keepBest)
+{
+    _keepBest = keepBest;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setSpeculation(unsigned int numThreads)
+{
+    _speculationThreads = numThreads;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setRequiredImprovement(double fraction)
+{
+    _requiredImprovement = std::max(fraction, 0.0);
+}
+
+
+
+// Whether the deadline has passed or the token has been cancelled. Once it
+// has, _stopped stays set until the next call to optimize().
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+bool
+Annealer<MoveType, CostType, MoveMgrType, RandType>::stopRequested()
+{
+    if ((_cancel != 0 && _cancel->isCancelled()) ||
+        (_timeBudget > 0.0 && std::chrono::steady_clock::now() >= _deadline)) {
+        _stopped = true;
+    }
+    return _stopped;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setCheckpoint(const std::string& filename,
+                                                                   int                interval)
+{
+    _checkpointFile = filename;
+    _checkpointInterval = std::max(interval, 0);
+}
+
+
+
+// A checkpoint is the header, this annealer's State and random number
+// generator, and then the move manager's state.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+bool
+Annealer<MoveType, CostType, MoveMgrType, RandType>::saveCheckpoint(std::string& error) const
+{
+    const std::string temp = _checkpointFile + ".tmp";
+    {
+        std::ofstream out(temp.c_str(), std::ios::binary);
+        if (!out) {
+            error = "can't open " + temp + " for writing";
+            return false;
+        }
+
+        out.write(checkpointMagic, sizeof(checkpointMagic));
+        saveValue(out, checkpointVersion);
+        saveValue(out, uint32_t(sizeof(CostType)));
+        saveValue(out, _seed);
+        saveValue(out, _state);
+        saveValue(out, _rand);
+        if (!_moveMgr->saveState(out)) {
+            error = "can't checkpoint the move manager's state";
+            return false;
         }
+        if (!out.flush()) {
+            error = "error writing " + temp;
+            return false;
+        }
+    }
+
+    // rename() won't replace an existing file on Windows.
+    remove(_checkpointFile.c_str());
+    if (rename(temp.c_str(), _checkpointFile.c_str()) != 0) {
+        error = "can't rename " + temp + " to " + _checkpointFile;
+        return false;
+    }
+
+    return true;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+bool
+Annealer<MoveType, CostType, MoveMgrType, RandType>::restore(const std::string& filename,
+                                                             MoveMgrType*       moveMgr,
+                                                             std::string&       error)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in) {
+        error = "can't open " + filename;
+        return false;
+    }
 
-        // There are more sophisticated cooling schedules, but I haven't done the
-        // research to figure out if the ones I know are trade secrets or prior art.
-        temp *= 0.95;
+    char         magic[sizeof(checkpointMagic)];
+    uint32_t     version;
+    uint32_t     costSize;
+    unsigned int seed;
+    State        state;
+    RandType     rand;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), checkpointMagic) ||
+        !loadValue(in, version) || version != checkpointVersion ||
+        !loadValue(in, costSize) || costSize != sizeof(CostType)) {
+        error = filename + " isn't a checkpoint from this version of the annealer";
+        return false;
+    }
+    if (!loadValue(in, seed) || !loadValue(in, state) || !loadValue(in, rand)) {
+        error = filename + " is truncated";
+        return false;
     }
+    if (!moveMgr->restoreState(in, error)) {
+        error = filename + ": " + error;
+        return false;
+    }
+
+    _seed = seed;
+    _state = state;
+    _rand = rand;
+    _resume = true;
 
-    std::cout << "t=" << temp << " c=" << _moveMgr->getScore() << "   --   ";
+    return true;
 }
 
 
@@ -113,9 +663,9 @@ Annealer<MoveType, CostType, MoveMgrType>::optimize(MoveMgrType* moveMgr)
 // Measure the starting temperature. This is done by performing a binary search until
 // we find the temperature at which we would make a roughly equal number of uphill vs.
 // downhill moves.
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 double
-Annealer<MoveType, CostType, MoveMgrType>::measureTemp()
+Annealer<MoveType, CostType, MoveMgrType, RandType>::measureTemp()
 {
     const int movesPerTempKnob  = 100;
     const int movesPerTemp      = movesPerTempKnob * _moveMgr->getProblemSize();
@@ -125,26 +675,28 @@ Annealer<MoveType, CostType, MoveMgrType>::measureTemp()
     double loTemp   = 0.00001;
     while (hiTemp - loTemp > 1.0) {
         const double temp = (hiTemp + loTemp) / 2.0;
+        setTemp(temp);
         int accepted = 0;
         for (int attempts = 0; attempts < movesPerTemp; ++attempts) {
+            if (attempts % stopCheckKnob == 0 && stopRequested()) {
+                return hiTemp;
+            }
+
             MoveType move;
             _moveMgr->generateMove(&move);
-            const CostType  deltaCost       = _moveMgr->proposeMove(&move);
-            const CostType  absDeltaCost    = abs(deltaCost);
-            const double    boltzmann       = exp(-absDeltaCost / temp);
-            if (deltaCost < 0 || getRand() < boltzmann) {
+            if (accept(_moveMgr->proposeMove(&move))) {
                 ++accepted;
             }
         }
 
-        std::cerr << "t=" << temp << " acc=" << accepted << " of " << movesPerTemp << " - going ";
+        if (observer() != 0) {
+            observer()->startTempProbe(temp, double(accepted) / movesPerTemp);
+        }
 
         if (accepted > halfMovesPerTemp) {
             hiTemp = temp;
-            std::cerr << "down" << std::endl;
         } else {
             loTemp = temp;
-            std::cerr << "up" << std::endl;
         }
     }
 
@@ -153,72 +705,267 @@ Annealer<MoveType, CostType, MoveMgrType>::measureTemp()
 
 
 
+// Estimate the starting temperature from one sample of uphill moves, by the
+// method of Ben-Ameur, "Computing the initial temperature of simulated
+// annealing", 2004. The acceptance ratio of the sampled moves at temperature
+// T is chi(T) = mean(exp(-deltaCost / T)), and iterating
+//
+//   T' = T * log(chi(T)) / log(chi0)
+//
+// converges quickly to the temperature where chi(T) is the target chi0. The
+// moves are all proposed from the starting state, which is left unchanged.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+double
+Annealer<MoveType, CostType, MoveMgrType, RandType>::sampleTemp()
+{
+    // Sample this many uphill moves, giving up after this many times as many
+    // attempts. A state with no uphill moves falls back to the binary search.
+    const int    uphillSamplesKnob  = 2000;
+    const int    maxAttemptsKnob    = 100;
+
+    // Stop iterating when chi is this close to the target.
+    const double toleranceKnob      = 0.001;
+    const int    maxIterationsKnob  = 100;
+
+    std::vector<double> deltas;
+    deltas.reserve(uphillSamplesKnob);
+    for (int attempts = 0;
+         int(deltas.size()) < uphillSamplesKnob && attempts < uphillSamplesKnob * maxAttemptsKnob;
+         ++attempts) {
+        MoveType move;
+        _moveMgr->generateMove(&move);
+        const CostType deltaCost = _moveMgr->proposeMove(&move);
+        if (deltaCost > 0) {
+            deltas.push_back(double(deltaCost));
+        }
+    }
+    if (deltas.empty()) {
+        return measureTemp();
+    }
+
+    // Start from the temperature that would accept the mean uphill move with
+    // probability chi0.
+    const double logTarget = log(_startAcceptRatio);
+    double       mean      = 0.0;
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        mean += deltas[i];
+    }
+    mean /= double(deltas.size());
+
+    double temp = -mean / logTarget;
+    for (int iteration = 0; iteration < maxIterationsKnob; ++iteration) {
+        double chi = 0.0;
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            chi += exp(-deltas[i] / temp);
+        }
+        chi /= double(deltas.size());
+
+        if (observer() != 0) {
+            observer()->startTempProbe(temp, chi);
+        }
+        if (chi <= 0.0) {
+            temp *= 2.0;
+            continue;
+        }
+        if (fabs(chi - _startAcceptRatio) < toleranceKnob) {
+            break;
+        }
+        temp *= log(chi) / logTarget;
+    }
+
+    return temp;
+}
+
+
+
 // Do an equilibrium. Standard simulated annealing Markov chain, gathering statistics
 // as we go.
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 void
-Annealer<MoveType, CostType, MoveMgrType>::equilibrate(const double temp,
-                                                       double&      meanCost,
-                                                       double&      costStdDev,
-                                                       double&      deltaCostStdDev,
-                                                       double&      acceptRatio)
+Annealer<MoveType, CostType, MoveMgrType, RandType>::equilibrate(const double      temp,
+                                                                 EquilibriumStats& stats)
 {
     const double maxAcceptKnob    = 10.0;
     const double maxAttemptKnob   = 100.0;
 
-    double       totalCost        = 0.0;
-    double       totalCostSq      = 0.0;
-    double       totalDeltaCost   = 0.0;
-    double       totalDeltaCostSq = 0.0;
-
-    int          attempts         = 0;
-    int          acceptances      = 0;
+    Totals       totals           = { 0.0, 0.0, 0.0, 0.0, 0, 0 };
     const int    maxAttempts      = int(_moveMgr->getProblemSize() * maxAttemptKnob);
     const int    maxAcceptances   = int(_moveMgr->getProblemSize() * maxAcceptKnob);
 
     CostType     curr_cost        = _moveMgr->getScore();
 
-    for (; attempts < maxAttempts && acceptances < maxAcceptances; attempts++) {        
-        MoveType move;
-        _moveMgr->generateMove(&move);
-
-        const CostType deltaCost    = _moveMgr->proposeMove(&move);
-        const CostType absDeltaCost = abs(deltaCost);
-        const double   boltzmann    = exp(-absDeltaCost / temp);
+    setTemp(temp);
+
+    const bool speculate = _speculator &&
+        _acceptRatio * _speculator->getNumThreads() * minSpeculateKnob < 1.0;
+
+    int nextStopCheck = stopCheckKnob;
+    if (speculate) {
+        const unsigned int numThreads = _speculator->getNumThreads();
+        _speculator->start(unsigned(_rand.next()));
+        while (totals.attempts < maxAttempts && totals.acceptances < maxAcceptances) {
+            if (totals.attempts >= nextStopCheck) {
+                if (stopRequested()) {
+                    break;
+                }
+                nextStopCheck += stopCheckKnob;
+            }
 
-        const double   prob         = absDeltaCost * boltzmann;
-        totalDeltaCost              += prob;
-        totalDeltaCostSq            += absDeltaCost * prob;
+            // Split the moves expected before the next acceptance between
+            // the threads, as in batched mode.
+            const int expected = totals.attempts / (totals.acceptances + 1) + 1;
+            const int left     = maxAttempts - totals.attempts;
+            const int chunk    = std::min(std::min(std::max(expected / int(numThreads), int(minSpeculateKnob)),
+                                                   int(maxSpeculateKnob)),
+                                          (left + int(numThreads) - 1) / int(numThreads));
+            _speculator->propose(chunk);
+
+            // Take the moves in sequence order up to the first one accepted.
+            bool accepted = false;
+            for (unsigned int t = 0; t < numThreads && !accepted; ++t) {
+                const MoveType* const moves  = _speculator->getMoves(t);
+                const CostType* const deltas = _speculator->getDeltas(t);
+                for (int i = 0; i < chunk && totals.attempts < maxAttempts; ++i) {
+                    if (attempt(&moves[i], deltas[i], curr_cost, totals)) {
+                        _speculator->accepted(moves[i]);
+                        accepted = true;
+                        break;
+                    }
+                }
+            }
+        }
+        _speculator->stop();
+    } else if (_batchSize == 1) {
+        while (totals.attempts < maxAttempts && totals.acceptances < maxAcceptances) {
+            if (totals.attempts >= nextStopCheck) {
+                if (stopRequested()) {
+                    break;
+                }
+                nextStopCheck += stopCheckKnob;
+            }
 
-        const double effProb = deltaCost < 0.0 ? 1.0 : boltzmann;
-        totalCost += curr_cost + effProb * deltaCost;
-        const double newCost = curr_cost + deltaCost;
-        totalCostSq += ((1.0 - effProb) * (curr_cost * curr_cost) + effProb * newCost * newCost);
+            MoveType move;
+            PROFILED(_profile, PhaseProfile::Generate, _moveMgr->generateMove(&move));
 
-        if (deltaCost < 0 || getRand() < boltzmann) {
-            _moveMgr->makeMove(&move);
+            const CostType deltaCost = PROFILED(_profile, PhaseProfile::Propose, _moveMgr->proposeMove(&move));
+            attempt(&move, deltaCost, curr_cost, totals);
+        }
+    } else {
+        while (totals.attempts < maxAttempts && totals.acceptances < maxAcceptances) {
+            if (totals.attempts >= nextStopCheck) {
+                if (stopRequested()) {
+                    break;
+                }
+                nextStopCheck += stopCheckKnob;
+            }
 
-            curr_cost += deltaCost;
-            assert(curr_cost == _moveMgr->getScore()); // FIX debugging only EXP
+            // Don't bother evaluating much more than the expected number of
+            // moves before the next acceptance, since the rest are wasted.
+            const int expected = totals.attempts / (totals.acceptances + 1) + 1;
+            const int n = std::min(std::min(int(_batchSize), expected), maxAttempts - totals.attempts);
+            for (int i = 0; i < n; ++i) {
+                PROFILED(_profile, PhaseProfile::Generate, _moveMgr->generateMove(&_batch[i]));
+            }
+            PROFILED_N(_profile, PhaseProfile::Propose, n, _moveMgr->proposeMoves(&_batch[0], &_batchDeltas[0], n));
 
-            acceptances++;
+            for (int i = 0; i < n; ++i) {
+                if (attempt(&_batch[i], _batchDeltas[i], curr_cost, totals)) {
+                    break;
+                }
+            }
         }
     }
 
-    const double n = double(attempts);
-    meanCost = double(totalCost) / n;
-    costStdDev = (totalCostSq / n) - ((totalCost * totalCost) / (n * n));
-    acceptRatio = double(acceptances) / n;
+    const double n = double(totals.attempts);
+    stats.meanCost = totals.cost / n;
+    stats.costStdDev = sqrt(std::max(totals.costSq / n - stats.meanCost * stats.meanCost, 0.0));
+    const double meanDeltaCost = totals.deltaCost / n;
+    stats.deltaCostStdDev = sqrt(std::max(totals.deltaCostSq / n - meanDeltaCost * meanDeltaCost, 0.0));
+    stats.acceptRatio = double(totals.acceptances) / n;
+    stats.attempts = totals.attempts;
+
+    _acceptRatio = stats.acceptRatio;
+}
+
+
+
+// Set the temperature for accept(), and fill in the table of thresholds.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+void
+Annealer<MoveType, CostType, MoveMgrType, RandType>::setTemp(const double temp)
+{
+    _temp = temp;
+    for (int i = 0; i < acceptTableSize; ++i) {
+        _threshold[i] = -temp * log(double(i + 1) / acceptTableSize);
+    }
+}
+
+
+
+// The Metropolis test at the temperature last given to setTemp().
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+inline bool
+Annealer<MoveType, CostType, MoveMgrType, RandType>::accept(const CostType deltaCost)
+{
+    if (deltaCost <= 0) {
+        return true;
+    }
+
+    // u lies in bucket i, (i / size, (i + 1) / size], so -temp * log(u) lies
+    // in [_threshold[i], _threshold[i - 1]).
+    const uint64_t r = _rand.next();
+    const int      i = int(r >> (64 - acceptTableBits));
+    if (double(deltaCost) < _threshold[i]) {
+        return true;
+    }
+    if (i > 0 && double(deltaCost) >= _threshold[i - 1]) {
+        return false;
+    }
+
+    const double u = double((r >> 11) + 1) * (1.0 / 9007199254740992.0);
+    return double(deltaCost) < -_temp * log(u);
+}
+
+
+
+// Consider one proposed move, make it if it passes the Metropolis test, and add
+// it to the running totals. Returns true if the move was made. The totals are
+// sample statistics of the chain, so they cost no more than the test itself.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+inline bool
+Annealer<MoveType, CostType, MoveMgrType, RandType>::attempt(const MoveType* move,
+                                                             const CostType  deltaCost,
+                                                             CostType&       curr_cost,
+                                                             Totals&         totals)
+{
+    ++totals.attempts;
+    totals.deltaCost += double(deltaCost);
+    totals.deltaCostSq += double(deltaCost) * double(deltaCost);
+
+    const bool accepted = PROFILED(_profile, PhaseProfile::Accept, accept(deltaCost));
+    if (accepted) {
+        // A vectorized proposeMoves may round differently from proposeMove,
+        // so track the cost the move manager actually charged.
+        curr_cost += PROFILED(_profile, PhaseProfile::Make, _moveMgr->makeMove(move));
+        assert(curr_cost == _moveMgr->getScore()); // FIX debugging only EXP
+
+        ++totals.acceptances;
+    }
+
+    totals.cost += double(curr_cost);
+    totals.costSq += double(curr_cost) * double(curr_cost);
+
+    return accepted;
 }
 
 
 
 // Compute the y-intercept of a line fit via least-squares
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 double
-Annealer<MoveType, CostType, MoveMgrType>::project(const int        n,
-                                                   const double*    x,
-                                                   const CostType*  y) const
+Annealer<MoveType, CostType, MoveMgrType, RandType>::project(const int        n,
+                                                             const double*    x,
+                                                             const CostType*  y) const
 {
     double sumX = 0.0;
     double sumXsq = 0.0;
@@ -236,21 +983,33 @@ Annealer<MoveType, CostType, MoveMgrType>::project(const int        n,
 
 
 
-// FIX use a better RNG.
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 void
-Annealer<MoveType, CostType, MoveMgrType>::seedRand(unsigned int seed)
+Annealer<MoveType, CostType, MoveMgrType, RandType>::seedRand(unsigned int seed)
 {
-    srand(seed);
+    _rand.seed(seed);
 }
 
 
 
-template<class MoveType, class CostType, class MoveMgrType>
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
 double
-Annealer<MoveType, CostType, MoveMgrType>::getRand()
+Annealer<MoveType, CostType, MoveMgrType, RandType>::getRand()
 {
-    return double(rand()) / 32768.0;
+    return _rand.uniform();
+}
+
+
+
+// Where progress goes, if anywhere.
+template<class MoveType, class CostType, class MoveMgrType, class RandType>
+IObserver*
+Annealer<MoveType, CostType, MoveMgrType, RandType>::observer()
+{
+    if (_observer != 0) {
+        return _observer;
+    }
+    return _verbose ? &_console : 0;
 }
 
 
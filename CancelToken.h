@@ -0,0 +1,68 @@
+// Cooperative cancellation of a running optimizer
+
+#if !defined(CANCELTOKEN_H)
+#define CANCELTOKEN_H
+
+#include <atomic>
+
+
+
+//******************************************************************************
+// CancelToken
+//
+// A flag that any thread, or a signal handler, can raise to ask an optimizer
+// to stop. The optimizer polls it every so many moves and returns as soon as
+// it notices, so a cancelled run ends within a fraction of a millisecond
+// rather than at the end of an equilibrium. Polling is a relaxed atomic load,
+// which costs nothing measurable.
+//******************************************************************************
+class CancelToken {
+  public:
+    CancelToken();
+
+    void                    cancel();
+    void                    reset();
+    bool                    isCancelled() const;
+
+  private:
+    CancelToken(const CancelToken&);                // not implemented
+    CancelToken&            operator=(const CancelToken&);
+
+    std::atomic<bool>       _cancelled;
+};
+
+
+
+inline
+CancelToken::CancelToken()
+:   _cancelled(false)
+{
+}
+
+
+
+inline void
+CancelToken::cancel()
+{
+    _cancelled.store(true, std::memory_order_relaxed);
+}
+
+
+
+inline void
+CancelToken::reset()
+{
+    _cancelled.store(false, std::memory_order_relaxed);
+}
+
+
+
+inline bool
+CancelToken::isCancelled() const
+{
+    return _cancelled.load(std::memory_order_relaxed);
+}
+
+
+
+#endif
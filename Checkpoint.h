@@ -0,0 +1,87 @@
+// Binary checkpoints of optimizer and move manager state
+
+#if !defined(CHECKPOINT_H)
+#define CHECKPOINT_H
+
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include <stdint.h>
+
+
+
+// A checkpoint is a stream of raw values in the machine's own byte order,
+// written by the optimizer and then by the move manager. It's meant for
+// restarting a run on the same machine and build, not for archiving, so the
+// only checks are a magic number, a version, and the sizes of the types.
+//
+// These helpers write and read single values and vectors of trivially
+// copyable types. The read functions return false once the stream has run out
+// or gone bad.
+const char      checkpointMagic[8]  = { 'O', 'P', 'T', 'C', 'K', 'P', 'T', '\0' };
+const uint32_t  checkpointVersion   = 1;
+
+
+
+template<class T>
+inline void
+saveValue(std::ostream& out,
+          const T&      value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpointed values must be trivially copyable");
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+
+
+template<class T>
+inline bool
+loadValue(std::istream& in,
+          T&            value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpointed values must be trivially copyable");
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(in);
+}
+
+
+
+template<class T>
+inline void
+saveVector(std::ostream&         out,
+           const std::vector<T>& v)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpointed values must be trivially copyable");
+    saveValue(out, uint64_t(v.size()));
+    if (!v.empty()) {
+        out.write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(T));
+    }
+}
+
+
+
+// The length is checked against maxSize before anything is allocated, so a
+// corrupt file can't ask for an enormous vector.
+template<class T>
+inline bool
+loadVector(std::istream&   in,
+           std::vector<T>& v,
+           const uint64_t  maxSize)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "checkpointed values must be trivially copyable");
+    uint64_t size;
+    if (!loadValue(in, size) || size > maxSize) {
+        return false;
+    }
+    v.resize(size_t(size));
+    if (size != 0) {
+        in.read(reinterpret_cast<char*>(&v[0]), size * sizeof(T));
+    }
+    return bool(in);
+}
+
+
+
+#endif
@@ -0,0 +1,191 @@
+// Cooling schedules for simulated annealing
+
+#if !defined(COOLINGSCHEDULE_H)
+#define COOLINGSCHEDULE_H
+
+#include <algorithm>
+
+#include <math.h>
+
+
+
+// What an equilibrium measured about the Markov chain at its temperature.
+struct EquilibriumStats {
+    double                  meanCost;
+    double                  costStdDev;
+    double                  deltaCostStdDev;
+    double                  acceptRatio;
+    int                     attempts;
+};
+
+
+
+//******************************************************************************
+// ICoolingSchedule
+//
+// Chooses the temperature of each equilibrium given the one before it. The
+// adaptive schedules use the statistics of the last equilibrium to move
+// quickly through temperatures where little changes, which is usually most of
+// the hot end, and slowly where the cost is changing fast.
+//******************************************************************************
+class ICoolingSchedule {
+  public:
+    virtual                 ~ICoolingSchedule() {}
+
+    virtual double          nextTemp(const double            temp,
+                                     const EquilibriumStats& stats) = 0;
+};
+
+
+
+//******************************************************************************
+// GeometricSchedule
+//
+// Multiplies the temperature by a constant factor. This is the Annealer's
+// default, with a factor of 0.95.
+//******************************************************************************
+class GeometricSchedule : public ICoolingSchedule {
+  public:
+    GeometricSchedule(double factor = 0.95);
+
+    virtual double          nextTemp(const double            temp,
+                                     const EquilibriumStats& stats);
+
+  private:
+    double                  _factor;
+};
+
+
+
+//******************************************************************************
+// HuangSchedule
+//
+// Huang, Romeo and Sangiovanni-Vincentelli's schedule, which keeps the drop in
+// mean cost from one equilibrium to the next to a fraction of the cost's
+// standard deviation:
+//
+//   T' = T * exp(-lambda * T / sigma)
+//
+// The factor is clamped to [minFactor, maxFactor], so the temperature neither
+// collapses when sigma is tiny nor stalls when it is large.
+//******************************************************************************
+class HuangSchedule : public ICoolingSchedule {
+  public:
+    HuangSchedule(double lambda    = 0.7,
+                  double minFactor = 0.5,
+                  double maxFactor = 0.99);
+
+    virtual double          nextTemp(const double            temp,
+                                     const EquilibriumStats& stats);
+
+  private:
+    double                  _lambda;
+    double                  _minFactor;
+    double                  _maxFactor;
+};
+
+
+
+//******************************************************************************
+// LamSchedule
+//
+// Lam and Delosme's schedule. After each move it steps the inverse
+// temperature s = 1/T by
+//
+//   ds = (lambda / sigma) * (1 / (s * sigma)^2) * 4 rho (1 - rho)^2 / (2 - rho)^2
+//
+// where rho is the acceptance ratio. The last factor peaks at rho of about
+// 0.44, so the schedule spends its time where the moves are most informative
+// and hurries through the hot and frozen ends. Here the steps for all the
+// attempts in an equilibrium are taken at once, and the change in
+// temperature is clamped the same way as HuangSchedule's.
+//******************************************************************************
+class LamSchedule : public ICoolingSchedule {
+  public:
+    LamSchedule(double lambda    = 0.1,
+                double minFactor = 0.5,
+                double maxFactor = 0.99);
+
+    virtual double          nextTemp(const double            temp,
+                                     const EquilibriumStats& stats);
+
+  private:
+    double                  _lambda;
+    double                  _minFactor;
+    double                  _maxFactor;
+};
+
+
+
+inline
+GeometricSchedule::GeometricSchedule(double factor)
+:   _factor(factor)
+{
+}
+
+
+
+inline double
+GeometricSchedule::nextTemp(const double            temp,
+                            const EquilibriumStats& stats)
+{
+    return temp * _factor;
+}
+
+
+
+inline
+HuangSchedule::HuangSchedule(double lambda,
+                             double minFactor,
+                             double maxFactor)
+:   _lambda(lambda),
+    _minFactor(minFactor),
+    _maxFactor(maxFactor)
+{
+}
+
+
+
+inline double
+HuangSchedule::nextTemp(const double            temp,
+                        const EquilibriumStats& stats)
+{
+    const double factor = stats.costStdDev > 0.0 ? exp(-_lambda * temp / stats.costStdDev) : 0.0;
+    return temp * std::min(std::max(factor, _minFactor), _maxFactor);
+}
+
+
+
+inline
+LamSchedule::LamSchedule(double lambda,
+                         double minFactor,
+                         double maxFactor)
+:   _lambda(lambda),
+    _minFactor(minFactor),
+    _maxFactor(maxFactor)
+{
+}
+
+
+
+inline double
+LamSchedule::nextTemp(const double            temp,
+                      const EquilibriumStats& stats)
+{
+    const double sigma = stats.costStdDev;
+    if (sigma <= 0.0) {
+        return temp * _minFactor;
+    }
+
+    const double s   = 1.0 / temp;
+    const double rho = stats.acceptRatio;
+    const double g   = 4.0 * rho * (1.0 - rho) * (1.0 - rho) / ((2.0 - rho) * (2.0 - rho));
+    const double ds  = stats.attempts * (_lambda / sigma) * g / ((s * sigma) * (s * sigma));
+
+    // T' / T = s / (s + ds)
+    return temp * std::min(std::max(s / (s + ds), _minFactor), _maxFactor);
+}
+
+
+
+#endif
@@ -2,6 +2,15 @@
 #if !defined(IOPTIMIZER_H)
 #define IOPTIMIZER_H
 
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stddef.h>
+
 
 
 //******************************************************************************
@@ -15,11 +24,17 @@ template<class MoveType,
 	     class CostType = double>
 class IMoveMgr {
   public:
+    virtual                 ~IMoveMgr() {}
+
     // Generate a move. For problems where there are multiple move
     // types, I suggest implementing a move base class from which
     // the moves of various types are derived. This use model is
     // why this and the other methods are passed a move pointer
-    // rather than a reference.
+    // rather than a reference. Since the optimizers create moves
+    // by value, though, the derived classes' extra data can't live
+    // in MoveType itself; a single move class with a tag for the
+    // kind of move, as TSPMove has, avoids that and the virtual
+    // calls.
     virtual void            generateMove(MoveType* move)      = 0;
 
     // Compute the delta-cost of a proposed move. This is new
@@ -29,6 +44,19 @@ class IMoveMgr {
     // is probably best to invert your score.
     virtual CostType	    proposeMove(const MoveType* move) = 0;
 
+    // Compute the delta-costs of a batch of proposed moves, all relative
+    // to the current state. This is optional; the default just calls
+    // proposeMove on each one, but a move manager whose deltas are cheap
+    // arithmetic can vectorize it.
+    virtual void            proposeMoves(const MoveType* moves,
+                                         CostType*       deltas,
+                                         size_t          n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            deltas[i] = proposeMove(&moves[i]);
+        }
+    }
+
     // Make a move, and return the delta-cost incurred. It's up to
     // you whether you compute that cost by calling proposeMove, but
     // note that typically this move will be the one for which
@@ -46,6 +74,58 @@ class IMoveMgr {
     // on the problem.
     virtual unsigned int    getProblemSize()                  = 0;
 
+    // Seed the random number generator used by generateMove. Optimizers
+    // that run several chains give each chain's move manager its own seed.
+    virtual void            seed(unsigned int seed)           {}
+
+    // Make a copy of this move manager, problem state and all. Optimizers
+    // that run several Markov chains at once use this to create their
+    // replicas, and the caller owns the result. If your move manager can't
+    // be copied, leave this returning 0 and just don't use those optimizers.
+    virtual IMoveMgr*       clone() const                     { return 0; }
+
+    // Overwrite this move manager's problem state with that of another one
+    // of the same concrete type, typically a clone of this one. This is how
+    // an optimizer hands the best state it found back to the caller.
+    virtual void            copyState(const IMoveMgr* other)  {}
+
+    // Local search. The problem is divided into getProblemSize()
+    // elements, such as the cities of a TSP. candidateMoves fills in
+    // the moves worth trying to improve the solution around an element,
+    // typically a short list built from the element's near neighbors,
+    // and touchedElements, called just before a move is made, gives the
+    // elements whose candidate moves the move will change. LocalOpt
+    // needs these; the defaults offer no moves at all.
+    virtual void            candidateMoves(int                    element,
+                                           std::vector<MoveType>& moves)
+    {
+        moves.clear();
+    }
+
+    virtual void            touchedElements(const MoveType*   move,
+                                            std::vector<int>& elements)
+    {
+        elements.clear();
+    }
+
+    // Write the problem state, and anything else needed to carry on from
+    // it such as the random number generator, to a binary checkpoint (see
+    // Checkpoint.h), and read it back into a move manager built on the
+    // same problem. The Annealer uses these for its checkpoints. Return
+    // false if checkpoints aren't supported or, when restoring, if the data
+    // doesn't fit this problem, with the reason in error.
+    virtual bool            saveState(std::ostream& out) const
+    {
+        return false;
+    }
+
+    virtual bool            restoreState(std::istream& in,
+                                         std::string&  error)
+    {
+        error = "this move manager doesn't support checkpoints";
+        return false;
+    }
+
     // Debugging harness. This is just a pass-through so that you
     // can easily add debug hooks to your move manager. The code
     // I've written never calls this.
@@ -54,6 +134,45 @@ class IMoveMgr {
 
 
 
+//******************************************************************************
+// IsMoveMgr
+//
+// IsMoveMgr<T, MoveType, CostType>::value is true if T has the methods an
+// optimizer calls on its move manager. The optimizers check their MoveMgrType
+// with this rather than requiring it to be an IMoveMgr, so a concrete move
+// manager class can be given directly. If that class is final, or isn't
+// derived from IMoveMgr at all, its calls are bound statically and can be
+// inlined into the optimizer's inner loop; with the default IMoveMgr they go
+// through the vtable.
+//******************************************************************************
+template<class T,
+         class MoveType,
+         class CostType,
+         class = void>
+struct IsMoveMgr : std::false_type {};
+
+template<class T,
+         class MoveType,
+         class CostType>
+struct IsMoveMgr<T, MoveType, CostType,
+                 std::void_t<decltype(std::declval<T&>().generateMove(std::declval<MoveType*>())),
+                             decltype(std::declval<T&>().proposeMoves(std::declval<const MoveType*>(),
+                                                                      std::declval<CostType*>(),
+                                                                      size_t(0))),
+                             decltype(std::declval<T&>().copyState(std::declval<const T*>())),
+                             decltype(std::declval<T&>().seed(0u))> >
+:   std::integral_constant<bool,
+        std::is_convertible<decltype(std::declval<T&>().proposeMove(std::declval<const MoveType*>())), CostType>::value &&
+        std::is_convertible<decltype(std::declval<T&>().makeMove(std::declval<const MoveType*>())), CostType>::value &&
+        std::is_convertible<decltype(std::declval<T&>().getScore()), CostType>::value &&
+        std::is_convertible<decltype(std::declval<T&>().getProblemSize()), unsigned int>::value &&
+        std::is_convertible<decltype(std::declval<const T&>().clone()), T*>::value &&
+        std::is_convertible<decltype(std::declval<const T&>().saveState(std::declval<std::ostream&>())), bool>::value &&
+        std::is_convertible<decltype(std::declval<T&>().restoreState(std::declval<std::istream&>(),
+                                                                     std::declval<std::string&>())), bool>::value> {};
+
+
+
 //******************************************************************************
 // IOptimizer
 //
@@ -1,49 +1,164 @@
-
-
 #if !defined(LOCALOPT_H)
 #define LOCALOPT_H
 
 #include <iostream>
+#include <vector>
+
+#include <math.h>
 
 #include "IOptimizer.h"
 
 
 
+//******************************************************************************
+// LocalOpt
+//
+// First-improvement descent over the move manager's candidate moves (see
+// IMoveMgr::candidateMoves). Every element starts out in a queue; an element
+// taken off the queue has its candidates tried in order until one improves
+// the score, which is made at once. The elements the move touched go back on
+// the queue, including this one, and the rest keep their "don't look" bits
+// set until a later move touches them.
+//
+// A move can also change the candidates of elements it didn't touch (a TSP
+// city whose neighbor got a new successor, say), so an empty queue isn't yet
+// a local minimum. When the queue empties, every element is queued again,
+// and the search ends after such a pass makes no move, i.e. at a local
+// minimum with respect to the candidate moves.
+//
+// With short candidate lists, as from a TSP's nearest neighbors, each element
+// is looked at a small number of times on average and few passes are needed,
+// so a descent from a good solution, such as at the end of an anneal, takes
+// time about linear in the problem size.
+//******************************************************************************
 template<class MoveType,
          class CostType    = double,
          class MoveMgrType = IMoveMgr<MoveType, CostType> >
 class LocalOpt : public IOptimizer<MoveType, CostType, MoveMgrType> {
   public:
+    LocalOpt();
+
     virtual void            optimize(MoveMgrType* moveMgr);
+
+    // A line with the number of moves made and the final score is written
+    // to stdout at the end unless this is turned off.
+    void                    setVerbose(bool verbose);
+
+    // The number of improving moves made by the last call to optimize().
+    long long               getMovesMade() const;
+
+  private:
+    bool                    _verbose;
+    long long               _movesMade;
 };
 
 
 
+template<class MoveType, class CostType, class MoveMgrType>
+LocalOpt<MoveType, CostType, MoveMgrType>::LocalOpt()
+:   _verbose(true),
+    _movesMade(0)
+{
+}
+
+
 
 template<class MoveType, class CostType, class MoveMgrType>
 void
 LocalOpt<MoveType, CostType, MoveMgrType>::optimize(MoveMgrType* moveMgr)
 {
-    const int missThreshold = 10000;
-    int       misses        = missThreshold;
+    // Only count a move as an improvement if it gains at least this fraction
+    // of the score, so that rounding in floating-point deltas can't make the
+    // search go back and forth between equivalent solutions.
+    const double toleranceKnob = 1e-12;
+
+    const int size = int(moveMgr->getProblemSize());
+
+    // A FIFO of the elements to look at, which holds each at most once; an
+    // element's don't-look bit is clear while it's queued.
+    std::vector<int>  queue(size);
+    std::vector<char> queued(size, 0);
+    int               head  = 0;
+    int               count = 0;
+
+    std::vector<MoveType> candidates;
+    std::vector<int>      touched;
+    long long             passStart = -1;
+    int                   passes    = 0;
+    _movesMade = 0;
+
+    while (count > 0 || _movesMade > passStart) {
+        if (count == 0) {
+            // start a pass over every element
+            passStart = _movesMade;
+            head = 0;
+            count = size;
+            for (int i = 0; i < size; ++i) {
+                queue[i] = i;
+                queued[i] = 1;
+            }
+            if (size == 0) {
+                break;
+            }
+            ++passes;
+        }
 
-    while (true) {
-        MoveType move;
-        moveMgr->generateMove(move);
+        const int element = queue[head];
+        head = head + 1 == size ? 0 : head + 1;
+        --count;
+        queued[element] = 0;
 
-        const CostType cost = moveMgr->proposeMove(move);
+        const double tolerance = toleranceKnob * (1.0 + fabs(double(moveMgr->getScore())));
 
-        if (cost < 0) {
-            moveMgr->makeMove(move);
-            misses = missThreshold;
-        } else {
-            if (--misses < 0) {
-                return;
+        moveMgr->candidateMoves(element, candidates);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const CostType delta = moveMgr->proposeMove(&candidates[i]);
+            if (double(delta) >= -tolerance) {
+                continue;
             }
+
+            moveMgr->touchedElements(&candidates[i], touched);
+            moveMgr->makeMove(&candidates[i]);
+            ++_movesMade;
+
+            touched.push_back(element);
+            for (size_t j = 0; j < touched.size(); ++j) {
+                const int t = touched[j];
+                if (!queued[t]) {
+                    queued[t] = 1;
+                    int tail = head + count;
+                    if (tail >= size) {
+                        tail -= size;
+                    }
+                    queue[tail] = t;
+                    ++count;
+                }
+            }
+            break;
         }
+    }
+
+    if (_verbose) {
+        std::cout << "local opt: moves=" << _movesMade << " passes=" << passes << " c=" << moveMgr->getScore() << "\n";
+    }
+}
 
-        std::cout << "Score = " << moveMgr->getScore() << "\n";
-   }
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+LocalOpt<MoveType, CostType, MoveMgrType>::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+long long
+LocalOpt<MoveType, CostType, MoveMgrType>::getMovesMade() const
+{
+    return _movesMade;
 }
 
 
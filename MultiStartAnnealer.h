@@ -0,0 +1,219 @@
+#if !defined(MULTISTARTANNEALER_H)
+#define MULTISTARTANNEALER_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <assert.h>
+
+#include "Annealer.h"
+#include "IOptimizer.h"
+#include "Observer.h"
+
+
+
+//******************************************************************************
+// MultiStartAnnealer
+//
+// Runs several independent anneals of the same problem, each from its own copy
+// of the starting state and with its own seed, and keeps the best result. The
+// runs are spread over a pool of threads, at most one run per thread at a time,
+// so with more runs than threads the extra runs queue up. Of runs that tie for
+// the best score, the lowest-numbered one wins, so the result doesn't depend
+// on which thread finishes first. The move manager must support clone() and
+// copyState().
+//******************************************************************************
+template<class MoveType,
+         class CostType    = double,
+         class MoveMgrType = IMoveMgr<MoveType, CostType> >
+class MultiStartAnnealer : public IOptimizer<MoveType, CostType, MoveMgrType> {
+  public:
+    // What happened on one run.
+    struct Run {
+        unsigned int        seed;
+        CostType            score;
+        double              seconds;    // wall-clock
+    };
+
+    // A thread count of 0 means one thread per hardware thread. Run i is
+    // seeded with seed + i, both the annealer and its move manager.
+    MultiStartAnnealer(unsigned int numRuns,
+                       unsigned int numThreads = 0,
+                       unsigned int seed       = 5241999);
+
+    virtual void            optimize(MoveMgrType* moveMgr);
+
+    // The runs from the last call to optimize, in seed order.
+    const std::vector<Run>& getRuns() const;
+
+    // Give every run's annealer this observer, which must be thread-safe,
+    // such as a RecordWriter. The records carry each run's seed.
+    void                    setObserver(IObserver* observer);
+
+    // A line per run and a summary are written to stdout at the end unless
+    // this is turned off. The runs themselves are never written to the
+    // console, since they'd be interleaved; give them an observer instead.
+    void                    setVerbose(bool verbose);
+
+  private:
+    void                    doRun(const unsigned int run,
+                                  MoveMgrType*       moveMgr);
+
+    unsigned int            _numRuns;
+    unsigned int            _numThreads;
+    unsigned int            _seed;
+    std::vector<Run>        _runs;
+    IObserver*              _observer;
+    bool                    _verbose;
+
+    MoveMgrType*            _best;      // copy of the best final state so far
+    unsigned int            _bestRun;   // the run it came from
+    std::mutex              _bestMutex;
+};
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::MultiStartAnnealer(unsigned int numRuns,
+                                                                        unsigned int numThreads,
+                                                                        unsigned int seed)
+:   _numRuns(numRuns),
+    _numThreads(numThreads),
+    _seed(seed),
+    _observer(0),
+    _verbose(true),
+    _best(0),
+    _bestRun(0)
+{
+    assert(_numRuns > 0);
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::optimize(MoveMgrType* moveMgr)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    unsigned int numThreads = _numThreads;
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+    if (numThreads > _numRuns) {
+        numThreads = _numRuns;
+    }
+
+    _runs.assign(_numRuns, Run());
+    _best = 0;
+
+    // Each worker pulls the next run off the queue until there are none left.
+    // The calling thread is one of the workers.
+    std::atomic<unsigned int> nextRun(0);
+    auto worker = [this, moveMgr, &nextRun]() {
+        for (unsigned int run = nextRun++; run < _numRuns; run = nextRun++) {
+            doRun(run, moveMgr);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numThreads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (unsigned int i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    moveMgr->copyState(_best);
+    delete _best;
+    _best = 0;
+
+    if (_verbose) {
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (unsigned int i = 0; i < _numRuns; ++i) {
+            std::cout << "run=" << i << " seed=" << _runs[i].seed << " c=" << _runs[i].score
+                      << " time=" << _runs[i].seconds << "\n";
+        }
+        std::cout << "runs=" << _numRuns << " threads=" << numThreads << " wall=" << elapsed
+                  << " c=" << moveMgr->getScore() << "   --   ";
+    }
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+const std::vector<typename MultiStartAnnealer<MoveType, CostType, MoveMgrType>::Run>&
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::getRuns() const
+{
+    return _runs;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::setObserver(IObserver* observer)
+{
+    _observer = observer;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+// Anneal a private copy of the starting state, then keep it if it's the best
+// so far, or ties with it and comes from an earlier run. Only one copy per thread plus the best one are alive at a time.
+template<class MoveType, class CostType, class MoveMgrType>
+void
+MultiStartAnnealer<MoveType, CostType, MoveMgrType>::doRun(const unsigned int run,
+                                                           MoveMgrType*       moveMgr)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    const unsigned int seed = _seed + run;
+
+    // The caller's move manager is only ever read while the runs are going,
+    // so cloning it from several threads at once is safe.
+    MoveMgrType* copy = static_cast<MoveMgrType*>(moveMgr->clone());
+    assert(copy != 0);
+    copy->seed(seed);
+
+    Annealer<MoveType, CostType, MoveMgrType> annealer(seed);
+    annealer.setVerbose(false);
+    annealer.setObserver(_observer);
+    annealer.optimize(copy);
+
+    Run& r = _runs[run];
+    r.seed = seed;
+    r.score = copy->getScore();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(_bestMutex);
+    const CostType bestScore = _best == 0 ? r.score : _best->getScore();
+    if (_best == 0 || r.score < bestScore || (r.score == bestScore && run < _bestRun)) {
+        delete _best;
+        _best = copy;
+        _bestRun = run;
+    } else {
+        delete copy;
+    }
+}
+
+
+
+#endif
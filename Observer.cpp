@@ -0,0 +1,151 @@
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+
+#include "Observer.h"
+
+using namespace std;
+
+
+
+RecordWriter::RecordWriter(Format format)
+:   _format(format),
+    _open(false),
+    _closing(false)
+{
+}
+
+
+
+RecordWriter::~RecordWriter()
+{
+    if (_open) {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _closing = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+}
+
+
+
+bool
+RecordWriter::open(const std::string& filename,
+                   std::string&       error)
+{
+    _file.open(filename.c_str());
+    if (!_file) {
+        error = "can't open " + filename + " for writing";
+        return false;
+    }
+
+    if (_format == Csv) {
+        _file << "seed,equilibrium,temp,cost,best,mean,stddev,accept,attempts,moves_per_sec,"
+                 "seconds,intercept,final\n";
+    }
+
+    _open = true;
+    _thread = thread(&RecordWriter::writeLoop, this);
+
+    return true;
+}
+
+
+
+void
+RecordWriter::equilibrium(const EquilibriumRecord& record)
+{
+    queue(record, false);
+}
+
+
+
+void
+RecordWriter::finished(const EquilibriumRecord& record)
+{
+    queue(record, true);
+}
+
+
+
+void
+RecordWriter::queue(const EquilibriumRecord& record,
+                    const bool               final)
+{
+    if (!_open) {
+        return;
+    }
+
+    const Entry entry = { record, final };
+    {
+        lock_guard<mutex> lock(_mutex);
+        _queue.push_back(entry);
+    }
+    _wake.notify_one();
+}
+
+
+
+// The writing thread. It takes everything queued at once, and writes it
+// without holding the lock.
+void
+RecordWriter::writeLoop()
+{
+    vector<Entry> batch;
+    for (;;) {
+        bool closing;
+        {
+            unique_lock<mutex> lock(_mutex);
+            while (_queue.empty() && !_closing) {
+                _wake.wait(lock);
+            }
+            batch.swap(_queue);
+            closing = _closing;
+        }
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            write(batch[i]);
+        }
+        batch.clear();
+
+        if (closing) {
+            _file.flush();
+            return;
+        }
+    }
+}
+
+
+
+void
+RecordWriter::write(const Entry& entry)
+{
+    const EquilibriumRecord& r = entry.record;
+
+    char intercept[32] = "";
+    if (r.projected) {
+        snprintf(intercept, sizeof(intercept), "%.10g", r.intercept);
+    }
+
+    char line[512];
+    if (_format == Csv) {
+        snprintf(line, sizeof(line), "%u,%d,%.10g,%.10g,%.10g,%.10g,%.10g,%.6g,%d,%.6g,%.6g,%s,%d\n",
+                 r.seed, r.equilibrium, r.temp, r.cost, r.bestCost, r.meanCost, r.costStdDev,
+                 r.acceptRatio, r.attempts, r.movesPerSec, r.seconds, intercept, entry.final ? 1 : 0);
+    } else {
+        snprintf(line, sizeof(line),
+                 "{\"seed\":%u,\"equilibrium\":%d,\"temp\":%.10g,\"cost\":%.10g,\"best\":%.10g,"
+                 "\"mean\":%.10g,\"stddev\":%.10g,\"accept\":%.6g,\"attempts\":%d,\"moves_per_sec\":%.6g,"
+                 "\"seconds\":%.6g,\"intercept\":%s,\"final\":%s}\n",
+                 r.seed, r.equilibrium, r.temp, r.cost, r.bestCost, r.meanCost, r.costStdDev,
+                 r.acceptRatio, r.attempts, r.movesPerSec, r.seconds, r.projected ? intercept : "null",
+                 entry.final ? "true" : "false");
+    }
+    _file << line;
+}
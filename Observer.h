@@ -0,0 +1,180 @@
+// Progress reports from the optimizers
+
+#if !defined(OBSERVER_H)
+#define OBSERVER_H
+
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+
+// What an Annealer reports after each equilibrium.
+struct EquilibriumRecord {
+    unsigned int            seed;           // the annealer's, to tell runs apart
+    int                     equilibrium;    // counting from 0
+    double                  temp;
+    double                  cost;           // at the end of the equilibrium
+    double                  bestCost;
+    double                  meanCost;
+    double                  costStdDev;
+    double                  acceptRatio;
+    int                     attempts;
+    double                  movesPerSec;
+    double                  seconds;        // since optimize() was called
+    bool                    projected;      // whether the stop criterion's line fit was done
+    double                  intercept;      // and if so, its cost at zero temperature
+};
+
+
+
+//******************************************************************************
+// IObserver
+//
+// Receives progress reports from an optimizer. The optimizer calls it once per
+// equilibrium, never from inside the Markov chain, so an observer costs the
+// inner loop nothing; an optimizer with no observer doesn't even fill in the
+// records. An observer shared by optimizers on several threads, as with
+// MultiStartAnnealer, must be thread-safe.
+//******************************************************************************
+class IObserver {
+  public:
+    virtual                 ~IObserver() {}
+
+    // One probe temperature tried while finding the starting temperature,
+    // and the fraction of moves that would be accepted at it.
+    virtual void            startTempProbe(const double temp,
+                                           const double acceptRatio) {}
+
+    virtual void            equilibrium(const EquilibriumRecord& record) = 0;
+
+    // The run is over. The record is that of the last equilibrium, except
+    // that temp is the temperature the schedule would have gone on to.
+    virtual void            finished(const EquilibriumRecord& record) {}
+};
+
+
+
+//******************************************************************************
+// ConsoleObserver
+//
+// Writes the Annealer's traditional progress lines: "t=... c=... s=..." per
+// equilibrium to out, and the starting temperature probes to log. Writing
+// happens on the optimizer's thread, so this is for interactive use.
+//******************************************************************************
+class ConsoleObserver : public IObserver {
+  public:
+    ConsoleObserver(std::ostream& out = std::cout,
+                    std::ostream& log = std::cerr);
+
+    virtual void            startTempProbe(const double temp,
+                                           const double acceptRatio);
+    virtual void            equilibrium(const EquilibriumRecord& record);
+    virtual void            finished(const EquilibriumRecord& record);
+
+  private:
+    std::ostream&           _out;
+    std::ostream&           _log;
+};
+
+
+
+//******************************************************************************
+// RecordWriter
+//
+// Writes equilibrium records to a file as CSV, with a header line, or as JSON
+// lines, one object per record. The optimizer's thread only queues each
+// record; a background thread formats and writes them, so a slow disk doesn't
+// hold up the anneal. The last record of each run has "final" set. This is
+// thread-safe, so one writer can collect the records of many runs.
+//******************************************************************************
+class RecordWriter : public IObserver {
+  public:
+    enum Format {
+        Csv,
+        JsonLines
+    };
+
+    RecordWriter(Format format);
+
+    // Writes out anything still queued, and closes the file.
+    ~RecordWriter();
+
+    // Open the file and start the writing thread. On failure, returns false
+    // and describes the problem in error.
+    bool                    open(const std::string& filename,
+                                 std::string&       error);
+
+    virtual void            equilibrium(const EquilibriumRecord& record);
+    virtual void            finished(const EquilibriumRecord& record);
+
+  private:
+    RecordWriter(const RecordWriter&);              // not implemented
+    RecordWriter&           operator=(const RecordWriter&);
+
+    struct Entry {
+        EquilibriumRecord   record;
+        bool                final;
+    };
+
+    void                    queue(const EquilibriumRecord& record,
+                                  const bool               final);
+    void                    writeLoop();
+    void                    write(const Entry& entry);
+
+    Format                  _format;
+    std::ofstream           _file;
+    std::thread             _thread;
+    std::mutex              _mutex;             // guards the rest
+    std::condition_variable _wake;
+    std::vector<Entry>      _queue;
+    bool                    _open;
+    bool                    _closing;
+};
+
+
+
+inline
+ConsoleObserver::ConsoleObserver(std::ostream& out,
+                                 std::ostream& log)
+:   _out(out),
+    _log(log)
+{
+}
+
+
+
+inline void
+ConsoleObserver::startTempProbe(const double temp,
+                                const double acceptRatio)
+{
+    _log << "t=" << temp << " acc=" << acceptRatio << std::endl;
+}
+
+
+
+inline void
+ConsoleObserver::equilibrium(const EquilibriumRecord& record)
+{
+    _out << "t=" << record.temp << " c=" << record.cost << " ";
+    if (record.projected) {
+        _out << "s=" << record.intercept;
+    }
+    _out << "\n";
+}
+
+
+
+inline void
+ConsoleObserver::finished(const EquilibriumRecord& record)
+{
+    _out << "t=" << record.temp << " c=" << record.cost << "   --   ";
+}
+
+
+
+#endif
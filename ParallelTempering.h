@@ -0,0 +1,234 @@
+#if !defined(PARALLELTEMPERING_H)
+#define PARALLELTEMPERING_H
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+#include "Annealer.h"
+#include "IOptimizer.h"
+#include "Observer.h"
+
+
+
+//******************************************************************************
+// ParallelTempering
+//
+// Replica exchange Monte Carlo. A ladder of replicas of the problem, each at a
+// fixed temperature, run one equilibrium apiece on their own threads. Between
+// equilibria, neighbouring replicas swap states according to the Metropolis
+// swap criterion, so that good states found at high temperature migrate down
+// the ladder to be refined at low temperature. The move manager must support
+// clone() and copyState(); the caller's move manager ends up holding the best
+// state seen by any replica.
+//
+// Progress is reported like an Annealer's, with a round of equilibria standing
+// for one equilibrium: each record is of the coldest replica.
+//******************************************************************************
+template<class MoveType,
+         class CostType    = double,
+         class MoveMgrType = IMoveMgr<MoveType, CostType> >
+class ParallelTempering : public IOptimizer<MoveType, CostType, MoveMgrType> {
+  public:
+    // A replica count of 0 means one replica per hardware thread. Replica i
+    // and its move manager are seeded with seed + i.
+    ParallelTempering(unsigned int numReplicas = 0,
+                      unsigned int seed        = 5241999);
+
+    virtual void            optimize(MoveMgrType* moveMgr);
+
+    // Progress is written to stdout/stderr by a ConsoleObserver unless this
+    // is turned off, or another observer is set.
+    void                    setVerbose(bool verbose);
+
+    // Report progress to the given observer, which the caller continues to
+    // own, instead of the console.
+    void                    setObserver(IObserver* observer);
+
+  private:
+    typedef Annealer<MoveType, CostType, MoveMgrType> Chain;
+
+    IObserver*              observer();
+
+    unsigned int            _numReplicas;
+    unsigned int            _seed;
+    bool                    _verbose;
+    IObserver*              _observer;
+    ConsoleObserver         _console;
+};
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+ParallelTempering<MoveType, CostType, MoveMgrType>::ParallelTempering(unsigned int numReplicas,
+                                                                      unsigned int seed)
+:   _numReplicas(numReplicas),
+    _seed(seed),
+    _verbose(true),
+    _observer(0)
+{
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+ParallelTempering<MoveType, CostType, MoveMgrType>::optimize(MoveMgrType* moveMgr)
+{
+    // The coldest replica runs at this fraction of the measured starting temperature.
+    // This is about where the Annealer's 0.95 cooling schedule usually converges.
+    const double    coldRatioKnob       = 0.001;
+
+    // Stop if this many rounds go by without any replica seeing a new best cost.
+    const int       roundsSinceBestKnob = 100;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    IObserver* const observer = this->observer();
+    EquilibriumRecord record = EquilibriumRecord();
+    record.seed = _seed;
+
+    unsigned int n = _numReplicas;
+    if (n == 0) {
+        n = std::thread::hardware_concurrency();
+    }
+    if (n < 2) {
+        n = 2;
+    }
+
+    std::vector<Chain>          chains(n);
+    std::vector<MoveMgrType*>   replicas(n);
+    std::vector<double>         temps(n);
+
+    // Seed the ladder from the Annealer's starting temperature. It is spaced
+    // geometrically, which gives roughly uniform swap acceptance when the heat
+    // capacity is roughly constant. temps[0] is the coldest rung.
+    for (unsigned int i = 0; i < n; ++i) {
+        chains[i].setVerbose(false);
+    }
+    chains[0].setObserver(observer);
+    chains[0].seedRand(_seed);
+    chains[0]._moveMgr = moveMgr;
+    const double hotTemp = chains[0].measureTemp();
+    for (unsigned int i = 0; i < n; ++i) {
+        temps[i] = hotTemp * pow(coldRatioKnob, double(n - 1 - i) / double(n - 1));
+        replicas[i] = static_cast<MoveMgrType*>(moveMgr->clone());
+        assert(replicas[i] != 0);
+        replicas[i]->seed(_seed + i);
+        chains[i].seedRand(_seed + i);
+    }
+
+    CostType best = moveMgr->getScore();
+
+    int roundsSinceBest = roundsSinceBestKnob;
+    for (int round = 0; best > 0 && roundsSinceBest-- > 0; ++round) {
+        const std::chrono::steady_clock::time_point roundStart = std::chrono::steady_clock::now();
+
+        // Do one equilibrium on each replica. Replica 0 runs on this thread.
+        std::vector<std::thread> threads;
+        EquilibriumStats         coldStats;
+        for (unsigned int i = 0; i < n; ++i) {
+            chains[i]._moveMgr = replicas[i];
+        }
+        for (unsigned int i = 1; i < n; ++i) {
+            threads.push_back(std::thread([&chains, &temps, i]() {
+                EquilibriumStats stats;
+                chains[i].equilibrate(temps[i], stats);
+            }));
+        }
+        chains[0].equilibrate(temps[0], coldStats);
+        for (unsigned int i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+
+        // If any replica has a new best score, hand it back to the caller.
+        for (unsigned int i = 0; i < n; ++i) {
+            const CostType c = replicas[i]->getScore();
+            if (c < best) {
+                best = c;
+                moveMgr->copyState(replicas[i]);
+                roundsSinceBest = roundsSinceBestKnob;
+            }
+        }
+
+        // Attempt swaps between neighbouring rungs, alternating between the even
+        // and odd pairs so that each replica takes part in at most one swap. The
+        // swap is accepted with probability min(1, exp((1/Ti - 1/Tj) * (Ei - Ej))).
+        // Swapping the replica pointers is equivalent to swapping their states.
+        for (unsigned int i = round % 2; i + 1 < n; i += 2) {
+            const double dBeta = 1.0 / temps[i] - 1.0 / temps[i + 1];
+            const double dCost = double(replicas[i]->getScore() - replicas[i + 1]->getScore());
+            const double arg   = dBeta * dCost;
+            if (arg >= 0.0 || chains[0].getRand() < exp(arg)) {
+                std::swap(replicas[i], replicas[i + 1]);
+            }
+        }
+
+        if (observer != 0) {
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            record.equilibrium = round;
+            record.temp = temps[0];
+            record.cost = double(replicas[0]->getScore());
+            record.bestCost = double(best);
+            record.meanCost = coldStats.meanCost;
+            record.costStdDev = coldStats.costStdDev;
+            record.acceptRatio = coldStats.acceptRatio;
+            record.attempts = coldStats.attempts;
+            record.movesPerSec = coldStats.attempts / std::chrono::duration<double>(now - roundStart).count();
+            record.seconds = std::chrono::duration<double>(now - start).count();
+            record.projected = false;
+            observer->equilibrium(record);
+        }
+    }
+
+    for (unsigned int i = 0; i < n; ++i) {
+        delete replicas[i];
+    }
+
+    if (observer != 0) {
+        record.temp = temps[0];
+        record.cost = double(moveMgr->getScore());
+        record.bestCost = double(best);
+        record.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        observer->finished(record);
+    }
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+ParallelTempering<MoveType, CostType, MoveMgrType>::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+ParallelTempering<MoveType, CostType, MoveMgrType>::setObserver(IObserver* observer)
+{
+    _observer = observer;
+}
+
+
+
+// Where progress goes, if anywhere.
+template<class MoveType, class CostType, class MoveMgrType>
+IObserver*
+ParallelTempering<MoveType, CostType, MoveMgrType>::observer()
+{
+    if (_observer != 0) {
+        return _observer;
+    }
+    return _verbose ? &_console : 0;
+}
+
+
+
+#endif
@@ -0,0 +1,242 @@
+// Cycle-level profiling of the annealer's inner loop
+
+#if !defined(PROFILE_H)
+#define PROFILE_H
+
+#include <ostream>
+
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+
+
+// Compile with OPTIMIZER_PROFILE defined to have the Annealer time each call
+// it makes on the move manager, and its own acceptance test, and print a
+// summary at the end of optimize(). Without it, PROFILED(profile, phase, expr)
+// is just expr, and likewise PROFILED_N, which counts expr as n calls, and
+// PROFILE_RETRY() is nothing, so there's no cost at all.
+//
+// Move managers whose generateMove has a rejection loop should put
+// PROFILE_RETRY() in the body of the loop, so that the summary can say how
+// many passes a move takes. When the Annealer speculates, only the share of
+// the moves generated and proposed on its own thread is counted.
+#if defined(OPTIMIZER_PROFILE)
+#define PROFILED(profile, phase, expr)          ((profile).time((phase), [&]() { return (expr); }))
+#define PROFILED_N(profile, phase, n, expr)     ((profile).time((phase), [&]() { return (expr); }, (n)))
+#define PROFILE_RETRY()                         (++PhaseProfile::tries)
+#else
+#define PROFILED(profile, phase, expr)          (expr)
+#define PROFILED_N(profile, phase, n, expr)     (expr)
+#define PROFILE_RETRY()                         ((void)0)
+#endif
+
+
+
+//******************************************************************************
+// PhaseProfile
+//
+// Call counts, total time and a histogram of the time per call for each phase
+// of a Markov chain move. Times are in TSC cycles on x86, where they're read
+// with rdtsc, and in nanoseconds elsewhere. The histogram buckets are powers
+// of two. Each Annealer has its own, so there's no sharing between threads.
+//******************************************************************************
+class PhaseProfile {
+  public:
+    enum Phase {
+        Generate,
+        Propose,
+        Make,
+        Accept,
+        NumPhases
+    };
+
+    PhaseProfile();
+
+    void                    reset();
+
+    // Evaluate f() as n calls of the given phase, and return its value.
+    template<class F>
+    auto                    time(const Phase phase,
+                                 F           f,
+                                 const int   n = 1) -> decltype(f());
+
+    void                    add(const Phase    phase,
+                                const uint64_t ticks,
+                                const int      n = 1);
+
+    void                    dump(std::ostream& out) const;
+
+    static uint64_t         now();
+
+    // Passes through generateMove rejection loops on this thread.
+    static thread_local uint64_t tries;
+
+  private:
+    // Adds the time from its construction to its destruction to a phase.
+    class Timer {
+      public:
+        Timer(PhaseProfile& profile,
+              const Phase   phase,
+              const int     n);
+        ~Timer();
+
+      private:
+        PhaseProfile&       _profile;
+        Phase               _phase;
+        int                 _n;
+        uint64_t            _start;
+    };
+
+    enum {
+        numBuckets = 40
+    };
+
+    uint64_t                _calls[NumPhases];
+    uint64_t                _ticks[NumPhases];
+    uint64_t                _histogram[NumPhases][numBuckets];
+    uint64_t                _startTries;
+};
+
+
+
+inline thread_local uint64_t PhaseProfile::tries = 0;
+
+
+
+inline
+PhaseProfile::PhaseProfile()
+{
+    reset();
+}
+
+
+
+inline void
+PhaseProfile::reset()
+{
+    for (int p = 0; p < NumPhases; ++p) {
+        _calls[p] = 0;
+        _ticks[p] = 0;
+        for (int b = 0; b < numBuckets; ++b) {
+            _histogram[p][b] = 0;
+        }
+    }
+    _startTries = tries;
+}
+
+
+
+template<class F>
+inline auto
+PhaseProfile::time(const Phase phase,
+                   F           f,
+                   const int   n) -> decltype(f())
+{
+    Timer timer(*this, phase, n);
+    return f();
+}
+
+
+
+inline void
+PhaseProfile::add(const Phase    phase,
+                  const uint64_t ticks,
+                  const int      n)
+{
+    _calls[phase] += n;
+    _ticks[phase] += ticks;
+
+    uint64_t perCall = ticks / n;
+    int      bucket  = 0;
+    while (perCall > 1 && bucket < numBuckets - 1) {
+        perCall >>= 1;
+        ++bucket;
+    }
+    _histogram[phase][bucket] += n;
+}
+
+
+
+// A table of the phases, and then each phase's histogram as "bucket:count"
+// pairs, where bucket b holds calls that took [2^b, 2^(b+1)) ticks.
+inline void
+PhaseProfile::dump(std::ostream& out) const
+{
+    static const char* const names[NumPhases] = { "generate", "propose", "make", "accept" };
+
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    const char* const unit = "cycles";
+#else
+    const char* const unit = "ns";
+#endif
+
+    uint64_t total = 0;
+    for (int p = 0; p < NumPhases; ++p) {
+        total += _ticks[p];
+    }
+
+    out << "profile (" << unit << "):\n";
+    for (int p = 0; p < NumPhases; ++p) {
+        out << "  " << names[p] << ": calls=" << _calls[p]
+            << " per call=" << (_calls[p] > 0 ? double(_ticks[p]) / _calls[p] : 0.0)
+            << " share=" << (total > 0 ? 100.0 * _ticks[p] / total : 0.0) << "%\n";
+        out << "   ";
+        for (int b = 0; b < numBuckets; ++b) {
+            if (_histogram[p][b] != 0) {
+                out << " " << b << ":" << _histogram[p][b];
+            }
+        }
+        out << "\n";
+    }
+
+    const uint64_t passes = tries - _startTries;
+    if (passes != 0 && _calls[Generate] != 0) {
+        out << "  generate retries=" << passes - _calls[Generate]
+            << " per move=" << double(passes - _calls[Generate]) / _calls[Generate] << "\n";
+    }
+}
+
+
+
+inline uint64_t
+PhaseProfile::now()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+
+inline
+PhaseProfile::Timer::Timer(PhaseProfile& profile,
+                           const Phase   phase,
+                           const int     n)
+:   _profile(profile),
+    _phase(phase),
+    _n(n),
+    _start(now())
+{
+}
+
+
+
+inline
+PhaseProfile::Timer::~Timer()
+{
+    _profile.add(_phase, now() - _start, _n);
+}
+
+
+
+#endif
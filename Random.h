@@ -0,0 +1,202 @@
+#if !defined(RANDOM_H)
+#define RANDOM_H
+
+#include <stdint.h>
+
+
+
+// Random number generators. Every optimizer and move manager owns one, with
+// its state in the object rather than in the C library, so that independent
+// Markov chains can run on separate threads and each run is reproducible from
+// its seed. Annealer takes the generator type as a template parameter; any
+// class with this interface will do:
+//
+//   seed(s)        reset the state from a 64-bit seed
+//   next()         uniformly distributed 64-bit integer
+//   uniform()      uniformly distributed double in [0, 1)
+//   below(n)       uniformly distributed integer in [0, n), n nonzero
+//
+// Checkpoints save a generator byte for byte, so it must also be trivially
+// copyable.
+
+
+
+//******************************************************************************
+// Xoshiro256
+//
+// xoshiro256** by Blackman and Vigna. Fast, with 256 bits of state and good
+// statistical quality. This is the default.
+//******************************************************************************
+class Xoshiro256 {
+  public:
+    Xoshiro256(uint64_t seed = 5241999);
+
+    void                    seed(uint64_t seed);
+    uint64_t                next();
+    double                  uniform();
+    unsigned int            below(unsigned int n);
+
+  private:
+    static uint64_t         rotl(const uint64_t x, const int k);
+
+    uint64_t                _s[4];
+};
+
+
+
+//******************************************************************************
+// Pcg32
+//
+// PCG-XSH-RR with 64 bits of state and 32-bit output, by O'Neill. Half the
+// state of Xoshiro256 and a single multiply per step; a 64-bit result takes
+// two steps.
+//******************************************************************************
+class Pcg32 {
+  public:
+    Pcg32(uint64_t seed = 5241999);
+
+    void                    seed(uint64_t seed);
+    uint64_t                next();
+    double                  uniform();
+    unsigned int            below(unsigned int n);
+
+  private:
+    uint32_t                next32();
+
+    uint64_t                _state;
+};
+
+
+
+typedef Xoshiro256 Random;
+
+
+
+inline
+Xoshiro256::Xoshiro256(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+
+
+// Expand the seed into the full state with splitmix64, as recommended by the
+// xoshiro authors. This guarantees the state is not all zeros.
+inline void
+Xoshiro256::seed(uint64_t seed)
+{
+    for (int i = 0; i < 4; ++i) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        _s[i] = z ^ (z >> 31);
+    }
+}
+
+
+
+inline uint64_t
+Xoshiro256::next()
+{
+    const uint64_t result = rotl(_s[1] * 5, 7) * 9;
+    const uint64_t t = _s[1] << 17;
+
+    _s[2] ^= _s[0];
+    _s[3] ^= _s[1];
+    _s[1] ^= _s[2];
+    _s[0] ^= _s[3];
+    _s[2] ^= t;
+    _s[3] = rotl(_s[3], 45);
+
+    return result;
+}
+
+
+
+inline double
+Xoshiro256::uniform()
+{
+    return double(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+// Lemire's multiply-shift. The bias is at most n / 2^32, which is negligible
+// for any problem size we care about.
+inline unsigned int
+Xoshiro256::below(unsigned int n)
+{
+    return (unsigned int)(((next() >> 32) * uint64_t(n)) >> 32);
+}
+
+
+
+inline uint64_t
+Xoshiro256::rotl(const uint64_t x,
+                 const int      k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+
+
+inline
+Pcg32::Pcg32(uint64_t seed)
+{
+    this->seed(seed);
+}
+
+
+
+// The stream increment is fixed, so only the state depends on the seed.
+inline void
+Pcg32::seed(uint64_t seed)
+{
+    _state = 0;
+    next32();
+    _state += seed;
+    next32();
+}
+
+
+
+inline uint32_t
+Pcg32::next32()
+{
+    const uint64_t old = _state;
+    _state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+
+    const uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+    const uint32_t rot = uint32_t(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+
+
+inline uint64_t
+Pcg32::next()
+{
+    const uint64_t hi = next32();
+    return (hi << 32) | next32();
+}
+
+
+
+inline double
+Pcg32::uniform()
+{
+    return double(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+
+inline unsigned int
+Pcg32::below(unsigned int n)
+{
+    return (unsigned int)((uint64_t(next32()) * uint64_t(n)) >> 32);
+}
+
+
+
+#endif
@@ -0,0 +1,132 @@
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+#include "SpatialGrid.h"
+
+using namespace std;
+
+
+
+SpatialGrid::SpatialGrid(const double* x,
+                         const double* y,
+                         const int     n)
+:   _x(x),
+    _y(y),
+    _size(n)
+{
+    assert(n > 0);
+
+    double maxX = x[0];
+    double maxY = y[0];
+    _minX = x[0];
+    _minY = y[0];
+    for (int i = 1; i < n; ++i) {
+        _minX = min(_minX, x[i]);
+        _minY = min(_minY, y[i]);
+        maxX = max(maxX, x[i]);
+        maxY = max(maxY, y[i]);
+    }
+
+    // Aim for about two points per cell. Guard against all the points lying
+    // on a line, or on top of each other.
+    const double width  = maxX - _minX;
+    const double height = maxY - _minY;
+    const double area   = max(width * height, max(width, height) * max(width, height) / n);
+    _cellSize = area > 0.0 ? sqrt(2.0 * area / n) : 1.0;
+    _cols = int(width / _cellSize) + 1;
+    _rows = int(height / _cellSize) + 1;
+
+    // Counting sort the points into cells.
+    const int numCells = _cols * _rows;
+    _cellStart.assign(numCells + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        ++_cellStart[row(y[i]) * _cols + column(x[i]) + 1];
+    }
+    for (int i = 0; i < numCells; ++i) {
+        _cellStart[i + 1] += _cellStart[i];
+    }
+    _cellPoints.resize(n);
+    vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        _cellPoints[fill[row(y[i]) * _cols + column(x[i])]++] = i;
+    }
+}
+
+
+
+void
+SpatialGrid::nearest(const int        c,
+                     const int        k,
+                     std::vector<int>& result) const
+{
+    result.clear();
+    const int want = min(k, _size - 1);
+    if (want <= 0) {
+        return;
+    }
+
+    // A max-heap on distance holds the best candidates found so far.
+    vector<pair<double, int> > heap;
+    heap.reserve(want + 1);
+
+    const double cx  = _x[c];
+    const double cy  = _y[c];
+    const int    col = column(cx);
+    const int    rw  = row(cy);
+    const int    maxRing = max(_cols, _rows);
+
+    for (int ring = 0; ring <= maxRing; ++ring) {
+        // Every point in this ring or beyond is at least (ring - 1) cells away
+        // in some direction, so if we already have enough points closer than
+        // that, we're done.
+        if (int(heap.size()) == want) {
+            const double reach = (ring - 1) * _cellSize;
+            if (ring > 0 && heap.front().first <= reach * reach) {
+                break;
+            }
+        }
+
+        const int r0 = rw - ring;
+        const int r1 = rw + ring;
+        const int c0 = col - ring;
+        const int c1 = col + ring;
+        for (int r = max(r0, 0); r <= min(r1, _rows - 1); ++r) {
+            // Only the boundary of the square is new in this ring.
+            const int step = (r == r0 || r == r1) ? 1 : c1 - c0;
+            for (int cl = c0; cl <= c1; cl += max(step, 1)) {
+                if (cl < 0 || cl >= _cols) {
+                    continue;
+                }
+                const int cell = r * _cols + cl;
+                for (int j = _cellStart[cell]; j < _cellStart[cell + 1]; ++j) {
+                    const int p = _cellPoints[j];
+                    if (p == c) {
+                        continue;
+                    }
+                    const double dx = _x[p] - cx;
+                    const double dy = _y[p] - cy;
+                    const double d2 = dx * dx + dy * dy;
+                    if (int(heap.size()) < want) {
+                        heap.push_back(make_pair(d2, p));
+                        push_heap(heap.begin(), heap.end());
+                    } else if (d2 < heap.front().first) {
+                        pop_heap(heap.begin(), heap.end());
+                        heap.back() = make_pair(d2, p);
+                        push_heap(heap.begin(), heap.end());
+                    }
+                }
+            }
+        }
+    }
+
+    sort_heap(heap.begin(), heap.end());
+    result.resize(heap.size());
+    for (int i = 0; i < int(heap.size()); ++i) {
+        result[i] = heap[i].second;
+    }
+}
@@ -0,0 +1,65 @@
+// Uniform grid spatial index for points in the plane
+
+#if !defined(SPATIALGRID_H)
+#define SPATIALGRID_H
+
+#include <vector>
+
+
+
+//******************************************************************************
+// SpatialGrid
+//
+// Buckets a set of points into square cells holding about two points each,
+// and answers k-nearest-neighbor queries by searching rings of cells outward
+// from the query point. For the roughly uniform point sets typical of
+// geometric TSP instances, a query costs O(k log k). The grid keeps pointers
+// to the coordinate arrays, which must outlive it.
+//******************************************************************************
+class SpatialGrid {
+  public:
+    SpatialGrid(const double* x,
+                const double* y,
+                const int     n);
+
+    // Find the k points nearest to point c, not counting c itself, in order
+    // of increasing distance. Fewer are returned if there aren't k others.
+    void                    nearest(const int c, const int k, std::vector<int>& result) const;
+
+  private:
+    int                     column(const double x) const;
+    int                     row(const double y) const;
+
+    const double*           _x;
+    const double*           _y;
+    int                     _size;
+    double                  _minX;
+    double                  _minY;
+    double                  _cellSize;
+    int                     _cols;
+    int                     _rows;
+    std::vector<int>        _cellStart;     // points in cell i are _cellPoints[_cellStart[i].._cellStart[i+1])
+    std::vector<int>        _cellPoints;
+};
+
+
+
+inline int
+SpatialGrid::column(const double x) const
+{
+    const int i = int((x - _minX) / _cellSize);
+    return i < 0 ? 0 : (i >= _cols ? _cols - 1 : i);
+}
+
+
+
+inline int
+SpatialGrid::row(const double y) const
+{
+    const int i = int((y - _minY) / _cellSize);
+    return i < 0 ? 0 : (i >= _rows ? _rows - 1 : i);
+}
+
+
+
+#endif
@@ -0,0 +1,319 @@
+// Speculative parallel evaluation of moves for a single annealing chain
+
+#if !defined(SPECULATOR_H)
+#define SPECULATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <assert.h>
+
+#include "IOptimizer.h"
+#include "Profile.h"
+
+
+
+//******************************************************************************
+// Speculator
+//
+// Proposes moves for one Markov chain on several threads at once. Thread 0 is
+// the caller, working on the chain's own move manager; each of the others
+// works on a replica of it. In a round, every thread generates a chunk of
+// moves from the current state and evaluates them with proposeMoves(). The
+// chain then considers them in sequence order, thread 0's first, exactly as
+// if they'd been proposed one after another, and stops at the first one it
+// accepts; the rest were proposed from a state that no longer exists and are
+// thrown away. The accepted move is replayed on every replica at the start of
+// the next round, so they stay in step with the chain.
+//
+// That pays off at low temperatures, where nearly every proposal is rejected,
+// so nearly every round is used in full. The move manager must support
+// clone(), copyState() and seed(), and moves generated on a replica must be
+// valid on the chain's move manager in the same state, as they are if a move
+// only names parts of the problem. Between start() and stop(), the workers
+// spin waiting for the next round, keeping their cores busy.
+//******************************************************************************
+template<class MoveType,
+         class CostType,
+         class MoveMgrType>
+class Speculator {
+  public:
+    // A thread count of 0 means one thread per hardware thread. Rounds are
+    // at most maxChunk moves per thread.
+    Speculator(MoveMgrType* moveMgr,
+               unsigned int numThreads,
+               int          maxChunk);
+    ~Speculator();
+
+    unsigned int            getNumThreads() const;
+    int                     getMaxChunk() const;
+
+    // Copy the move manager's state to the replicas, seed replica i with
+    // seed + i, and start the worker threads.
+    void                    start(unsigned int seed);
+
+    // Stop the worker threads. The replicas must be started again, which
+    // brings them up to date, before the next round.
+    void                    stop();
+
+    // Generate and evaluate chunk moves on each thread, and wait for them
+    // all. Thread i's moves and their deltas are then in getMoves(i) and
+    // getDeltas(i).
+    void                    propose(int chunk);
+    const MoveType*         getMoves(unsigned int thread) const;
+    const CostType*         getDeltas(unsigned int thread) const;
+
+    // The chain made this move, one of the last round's, on the move
+    // manager.
+    void                    accepted(const MoveType& move);
+
+#if defined(OPTIMIZER_PROFILE)
+    // Time the calling thread's generateMove and proposeMoves calls in this
+    // profile, as the Annealer does its own; the other threads' aren't.
+    void                    setProfile(PhaseProfile* profile);
+#endif
+
+  private:
+    Speculator(const Speculator&);                  // not implemented
+    Speculator&             operator=(const Speculator&);
+
+    MoveMgrType*            replica(unsigned int thread);
+    void                    proposeChunk(unsigned int thread);
+    void                    work(unsigned int thread,
+                                 unsigned int round);
+
+    MoveMgrType*                              _moveMgr;
+    unsigned int                              _numThreads;
+    int                                       _maxChunk;
+    std::vector<std::unique_ptr<MoveMgrType> > _replicas;  // [0] is unused; thread 0 works on _moveMgr
+    std::vector<std::vector<MoveType> >       _moves;
+    std::vector<std::vector<CostType> >       _deltas;
+    std::vector<std::thread>                  _threads;
+
+    // Written by the caller between rounds, and read by the workers once
+    // they see _round change.
+    int                                       _chunk;
+    MoveType                                  _pending;
+    bool                                      _hasPending;
+    bool                                      _quit;
+
+    std::atomic<unsigned int>                 _round;
+    std::atomic<unsigned int>                 _done;     // workers finished with this round
+#if defined(OPTIMIZER_PROFILE)
+    PhaseProfile*                             _profile;
+#endif
+};
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+Speculator<MoveType, CostType, MoveMgrType>::Speculator(MoveMgrType* moveMgr,
+                                                        unsigned int numThreads,
+                                                        int          maxChunk)
+:   _moveMgr(moveMgr),
+    _numThreads(numThreads),
+    _maxChunk(std::max(maxChunk, 1)),
+    _chunk(0),
+    _hasPending(false),
+    _quit(false),
+    _round(0),
+    _done(0)
+{
+#if defined(OPTIMIZER_PROFILE)
+    _profile = 0;
+#endif
+
+    if (_numThreads == 0) {
+        _numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    _replicas.resize(_numThreads);
+    for (unsigned int i = 1; i < _numThreads; ++i) {
+        _replicas[i].reset(static_cast<MoveMgrType*>(_moveMgr->clone()));
+        assert(_replicas[i] != 0);
+    }
+
+    _moves.resize(_numThreads, std::vector<MoveType>(_maxChunk));
+    _deltas.resize(_numThreads, std::vector<CostType>(_maxChunk));
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+Speculator<MoveType, CostType, MoveMgrType>::~Speculator()
+{
+    stop();
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+unsigned int
+Speculator<MoveType, CostType, MoveMgrType>::getNumThreads() const
+{
+    return _numThreads;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+int
+Speculator<MoveType, CostType, MoveMgrType>::getMaxChunk() const
+{
+    return _maxChunk;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::start(unsigned int seed)
+{
+    assert(_threads.empty());
+
+    _hasPending = false;
+    _quit = false;
+    for (unsigned int i = 1; i < _numThreads; ++i) {
+        _replicas[i]->copyState(_moveMgr);
+        _replicas[i]->seed(seed + i);
+        _threads.push_back(std::thread(&Speculator::work, this, i, _round.load()));
+    }
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::stop()
+{
+    if (_threads.empty()) {
+        return;
+    }
+
+    _quit = true;
+    _round.fetch_add(1, std::memory_order_release);
+    for (unsigned int i = 0; i < _threads.size(); ++i) {
+        _threads[i].join();
+    }
+    _threads.clear();
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::propose(int chunk)
+{
+    assert(_threads.size() + 1 == _numThreads);
+
+    _chunk = std::min(std::max(chunk, 1), _maxChunk);
+    _done.store(0, std::memory_order_relaxed);
+    _round.fetch_add(1, std::memory_order_release);
+
+    // this thread's share, timed like the Annealer's own calls
+    MoveType* const moves = &_moves[0][0];
+    for (int i = 0; i < _chunk; ++i) {
+        PROFILED(*_profile, PhaseProfile::Generate, _moveMgr->generateMove(&moves[i]));
+    }
+    PROFILED_N(*_profile, PhaseProfile::Propose, _chunk, _moveMgr->proposeMoves(moves, &_deltas[0][0], _chunk));
+
+    while (_done.load(std::memory_order_acquire) < _numThreads - 1) {
+        std::this_thread::yield();
+    }
+    _hasPending = false;
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+inline const MoveType*
+Speculator<MoveType, CostType, MoveMgrType>::getMoves(unsigned int thread) const
+{
+    return &_moves[thread][0];
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+inline const CostType*
+Speculator<MoveType, CostType, MoveMgrType>::getDeltas(unsigned int thread) const
+{
+    return &_deltas[thread][0];
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::accepted(const MoveType& move)
+{
+    _pending = move;
+    _hasPending = true;
+}
+
+
+
+#if defined(OPTIMIZER_PROFILE)
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::setProfile(PhaseProfile* profile)
+{
+    _profile = profile;
+}
+#endif
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+inline MoveMgrType*
+Speculator<MoveType, CostType, MoveMgrType>::replica(unsigned int thread)
+{
+    return thread == 0 ? _moveMgr : _replicas[thread].get();
+}
+
+
+
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::proposeChunk(unsigned int thread)
+{
+    MoveMgrType* const moveMgr = replica(thread);
+    MoveType* const    moves   = &_moves[thread][0];
+    for (int i = 0; i < _chunk; ++i) {
+        moveMgr->generateMove(&moves[i]);
+    }
+    moveMgr->proposeMoves(moves, &_deltas[thread][0], _chunk);
+}
+
+
+
+// A worker's loop: wait for the round to change, catch up with the chain's
+// last accepted move, and do this thread's share of the round.
+template<class MoveType, class CostType, class MoveMgrType>
+void
+Speculator<MoveType, CostType, MoveMgrType>::work(unsigned int thread,
+                                                  unsigned int round)
+{
+    for (;;) {
+        while (_round.load(std::memory_order_acquire) == round) {
+            std::this_thread::yield();
+        }
+        ++round;
+        if (_quit) {
+            return;
+        }
+
+        if (_hasPending) {
+            _replicas[thread]->makeMove(&_pending);
+        }
+        proposeChunk(thread);
+        _done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+
+#endif
@@ -0,0 +1,438 @@
+#include <algorithm>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+#include "SpatialGrid.h"
+#include "TSPConstruction.h"
+#include "TSPInstance.h"
+
+using namespace std;
+
+
+
+//******************************************************************************
+// PointSet
+//
+// A set of cities that can only shrink, answering which member is nearest a
+// given city. With coordinates the members are bucketed into a grid of square
+// cells, about two per cell to start with, and a query searches rings of
+// cells outward until no closer member can be in the next ring. Without,
+// everything is in one cell and a query looks at every member.
+//******************************************************************************
+class PointSet {
+  public:
+    PointSet(const TSPInstance&      instance,
+             const std::vector<int>& members);
+
+    bool                    contains(const int c) const { return _pos[c] >= 0; }
+    void                    remove(const int c);
+
+    // The member nearest city c, other than c itself, or -1 if there's none.
+    int                     nearest(const int c) const;
+
+  private:
+    int                     cellOf(const int c) const;
+    double                  distance(const int a,
+                                     const int b) const;
+
+    const TSPInstance&      _instance;
+    const double*           _x;
+    const double*           _y;
+    double                  _minX;
+    double                  _minY;
+    double                  _cellSize;
+    int                     _cols;
+    int                     _rows;
+    std::vector<int>        _cellStart;     // cell k's members are _cities[_cellStart[k]] on,
+    std::vector<int>        _cellCount;     // _cellCount[k] of them
+    std::vector<int>        _cities;
+    std::vector<int>        _pos;           // _pos[c] is c's index in _cities, or -1
+};
+
+
+
+PointSet::PointSet(const TSPInstance&      instance,
+                   const std::vector<int>& members)
+:   _instance(instance),
+    _x(instance.getX()),
+    _y(instance.getY()),
+    _minX(0.0),
+    _minY(0.0),
+    _cellSize(1.0),
+    _cols(1),
+    _rows(1),
+    _pos(instance.getSize(), -1)
+{
+    const int m = int(members.size());
+
+    if (_x != 0 && m > 0) {
+        double maxX = _x[members[0]];
+        double maxY = _y[members[0]];
+        _minX = maxX;
+        _minY = maxY;
+        for (int i = 1; i < m; ++i) {
+            _minX = min(_minX, _x[members[i]]);
+            _minY = min(_minY, _y[members[i]]);
+            maxX = max(maxX, _x[members[i]]);
+            maxY = max(maxY, _y[members[i]]);
+        }
+        const double width  = maxX - _minX;
+        const double height = maxY - _minY;
+
+        // Cells of two members each if they're spread evenly, but no more
+        // than m along a side if they're all in a line.
+        _cellSize = max(max(sqrt(2.0 * width * height / m), max(width, height) / m), 1e-300);
+        _cols = min(int(width / _cellSize) + 1, m + 1);
+        _rows = min(int(height / _cellSize) + 1, m + 1);
+    }
+
+    _cellStart.assign(size_t(_cols) * _rows + 1, 0);
+    _cellCount.assign(size_t(_cols) * _rows, 0);
+    for (int i = 0; i < m; ++i) {
+        ++_cellCount[cellOf(members[i])];
+    }
+    for (size_t k = 0; k < _cellCount.size(); ++k) {
+        _cellStart[k + 1] = _cellStart[k] + _cellCount[k];
+    }
+
+    _cities.resize(m);
+    vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+    for (int i = 0; i < m; ++i) {
+        const int c = members[i];
+        _pos[c] = fill[cellOf(c)]++;
+        _cities[_pos[c]] = c;
+    }
+}
+
+
+
+void
+PointSet::remove(const int c)
+{
+    assert(contains(c));
+
+    const int k    = cellOf(c);
+    const int last = _cellStart[k] + --_cellCount[k];
+    const int d    = _cities[last];
+    _cities[_pos[c]] = d;
+    _pos[d] = _pos[c];
+    _cities[last] = c;
+    _pos[c] = -1;
+}
+
+
+
+int
+PointSet::nearest(const int c) const
+{
+    const int cell = cellOf(c);
+    const int cx   = cell % _cols;
+    const int cy   = cell / _cols;
+    const int last = max(max(cx, _cols - 1 - cx), max(cy, _rows - 1 - cy));
+
+    int    best     = -1;
+    double bestDist = 0.0;
+    for (int r = 0; r <= last; ++r) {
+        // Everything in ring r is at least r - 1 cells away.
+        if (best >= 0 && r > 0) {
+            const double bound = (r - 1) * _cellSize;
+            if (bound * bound >= bestDist) {
+                break;
+            }
+        }
+
+        for (int j = max(cy - r, 0); j <= min(cy + r, _rows - 1); ++j) {
+            const bool edgeRow = j == cy - r || j == cy + r;
+            const int  step    = edgeRow ? 1 : 2 * r;
+            for (int i = cx - r; i <= cx + r; i += step) {
+                if (i < 0 || i >= _cols) {
+                    continue;
+                }
+                const int k = j * _cols + i;
+                for (int p = _cellStart[k]; p < _cellStart[k] + _cellCount[k]; ++p) {
+                    const int d = _cities[p];
+                    if (d == c) {
+                        continue;
+                    }
+                    const double dist = distance(c, d);
+                    if (best < 0 || dist < bestDist) {
+                        best = d;
+                        bestDist = dist;
+                    }
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+
+
+inline int
+PointSet::cellOf(const int c) const
+{
+    if (_x == 0) {
+        return 0;
+    }
+    const int i = min(max(int((_x[c] - _minX) / _cellSize), 0), _cols - 1);
+    const int j = min(max(int((_y[c] - _minY) / _cellSize), 0), _rows - 1);
+    return j * _cols + i;
+}
+
+
+
+// The squared Euclidean distance with coordinates, which is what the ring
+// bound is in terms of, or the instance's distance without.
+inline double
+PointSet::distance(const int a,
+                   const int b) const
+{
+    if (_x == 0) {
+        return _instance.dist(a, b);
+    }
+    const double dx = _x[a] - _x[b];
+    const double dy = _y[a] - _y[b];
+    return dx * dx + dy * dy;
+}
+
+
+
+// The root of c's set in a union-find forest, halving the path on the way.
+static int
+findRoot(std::vector<int>& parent,
+         int               c)
+{
+    while (parent[c] != c) {
+        parent[c] = parent[parent[c]];
+        c = parent[c];
+    }
+    return c;
+}
+
+
+
+void
+TSPConstruction::build(const TSPInstance& instance,
+                       const Method       method,
+                       std::vector<int>&  order)
+{
+    switch (method) {
+      case NearestNeighborTour:
+        nearestNeighbor(instance, order);
+        break;
+
+      case GreedyTour:
+      case SavingsTour: {
+        // Savings are measured from the city nearest the middle.
+        int hub = -1;
+        if (method == SavingsTour) {
+            hub = 0;
+            if (instance.hasCoords()) {
+                const int     n  = instance.getSize();
+                const double* x  = instance.getX();
+                const double* y  = instance.getY();
+                double        mx = 0.0;
+                double        my = 0.0;
+                for (int c = 0; c < n; ++c) {
+                    mx += x[c] / n;
+                    my += y[c] / n;
+                }
+                for (int c = 1; c < n; ++c) {
+                    if (hypot(x[c] - mx, y[c] - my) < hypot(x[hub] - mx, y[hub] - my)) {
+                        hub = c;
+                    }
+                }
+            }
+        }
+
+        vector<int> adj;
+        matchEdges(instance, hub, adj);
+        joinPaths(instance, adj, order);
+        break;
+      }
+
+      case SpaceFillingCurveTour:
+      default:
+        instance.hilbertOrder(order);
+        break;
+    }
+
+    assert(int(order.size()) == instance.getSize());
+}
+
+
+
+void
+TSPConstruction::nearestNeighbor(const TSPInstance& instance,
+                                 std::vector<int>&  order)
+{
+    const int n = instance.getSize();
+
+    vector<int> all(n);
+    for (int c = 0; c < n; ++c) {
+        all[c] = c;
+    }
+    PointSet unvisited(instance, all);
+
+    order.clear();
+    order.reserve(n);
+    int c = 0;
+    for (;;) {
+        order.push_back(c);
+        unvisited.remove(c);
+        const int next = unvisited.nearest(c);
+        if (next < 0) {
+            break;
+        }
+        c = next;
+    }
+}
+
+
+
+// Consider the edges from each city to its nearest neighbors in order, and
+// take each one that leaves both its cities with at most two edges and closes
+// no cycle, giving paths as the two neighbors of each city in adj (-1 for
+// none). Greedy takes the shortest edges first. Savings, given a hub, takes
+// first the edges that save the most over going to the hub and back, and
+// leaves the hub out.
+void
+TSPConstruction::matchEdges(const TSPInstance& instance,
+                            const int          hub,
+                            std::vector<int>&  adj)
+{
+    // How many of each city's nearest neighbors to consider joining it to
+    const int neighborsKnob = 10;
+
+    struct Edge {
+        double              key;
+        int                 a;
+        int                 b;
+    };
+
+    const int n = instance.getSize();
+    const int k = min(neighborsKnob, n - 1);
+
+    vector<int> neighbors(size_t(n) * k);
+    vector<int> nearest;
+    if (instance.hasCoords()) {
+        const SpatialGrid grid(instance.getX(), instance.getY(), n);
+        for (int c = 0; c < n; ++c) {
+            grid.nearest(c, k, nearest);
+            copy(nearest.begin(), nearest.end(), neighbors.begin() + size_t(c) * k);
+        }
+    } else {
+        vector<pair<double, int> > row(n - 1);
+        for (int c = 0; c < n; ++c) {
+            for (int i = 0, j = 0; i < n; ++i) {
+                if (i != c) {
+                    row[j++] = make_pair(instance.dist(c, i), i);
+                }
+            }
+            partial_sort(row.begin(), row.begin() + k, row.end());
+            for (int i = 0; i < k; ++i) {
+                neighbors[size_t(c) * k + i] = row[i].second;
+            }
+        }
+    }
+
+    // Each edge once: from the lower-numbered city if each is among the
+    // other's neighbors.
+    vector<Edge> edges;
+    edges.reserve(size_t(n) * k / 2);
+    for (int a = 0; a < n; ++a) {
+        for (int i = 0; i < k; ++i) {
+            const int b = neighbors[size_t(a) * k + i];
+            if (b < a) {
+                const int* bn = &neighbors[size_t(b) * k];
+                if (find(bn, bn + k, a) != bn + k) {
+                    continue;
+                }
+            }
+            if (a == hub || b == hub) {
+                continue;
+            }
+            Edge e;
+            e.a = a;
+            e.b = b;
+            e.key = instance.dist(a, b);
+            if (hub >= 0) {
+                e.key -= instance.dist(hub, a) + instance.dist(hub, b);
+            }
+            edges.push_back(e);
+        }
+    }
+    sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) {
+        return x.key < y.key;
+    });
+
+    adj.assign(2 * size_t(n), -1);
+    vector<int> parent(n);
+    for (int c = 0; c < n; ++c) {
+        parent[c] = c;
+    }
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const int a = edges[i].a;
+        const int b = edges[i].b;
+        if (adj[2 * a + 1] >= 0 || adj[2 * b + 1] >= 0) {
+            continue;
+        }
+        const int ra = findRoot(parent, a);
+        const int rb = findRoot(parent, b);
+        if (ra == rb) {
+            continue;
+        }
+        parent[ra] = rb;
+        adj[2 * a + (adj[2 * a] < 0 ? 0 : 1)] = b;
+        adj[2 * b + (adj[2 * b] < 0 ? 0 : 1)] = a;
+    }
+}
+
+
+
+// Make a tour of the paths in adj: follow one to its other end, go on to the
+// nearest end of another path, and so on.
+void
+TSPConstruction::joinPaths(const TSPInstance&      instance,
+                           const std::vector<int>& adj,
+                           std::vector<int>&       order)
+{
+    const int n = instance.getSize();
+
+    vector<int> ends;
+    for (int c = 0; c < n; ++c) {
+        if (adj[2 * c + 1] < 0) {
+            ends.push_back(c);
+        }
+    }
+    assert(!ends.empty());
+    PointSet unused(instance, ends);
+
+    order.clear();
+    order.reserve(n);
+    int start = ends[0];
+    for (;;) {
+        int prev = -1;
+        int c    = start;
+        for (;;) {
+            order.push_back(c);
+            if (unused.contains(c)) {
+                unused.remove(c);
+            }
+            const int next = adj[2 * c] != prev ? adj[2 * c] : adj[2 * c + 1];
+            if (next < 0) {
+                break;
+            }
+            prev = c;
+            c = next;
+        }
+
+        start = unused.nearest(c);
+        if (start < 0) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+#include "Annealer.h"
+#include "CancelToken.h"
+#include "TSPDecomposer.h"
+#include "TSPInstance.h"
+#include "TSPMove.h"
+#include "TSPMoveMgr.h"
+
+using namespace std;
+
+
+
+TSPDecomposer::TSPDecomposer(std::shared_ptr<const TSPInstance> instance,
+                             unsigned int                       numThreads,
+                             unsigned int                       seed)
+:   _instance(instance),
+    _numThreads(numThreads),
+    _seed(seed),
+    _rounds(4),
+    _regionSize(10000),
+    _rep(TSPMoveMgr::ArrayRep),
+    _mode(TSPMoveMgr::UniformGen),
+    _orOptFraction(0.0),
+    _threeOptFraction(0.0),
+    _timeBudget(0.0),
+    _cancel(0),
+    _verbose(true)
+{
+}
+
+
+
+void
+TSPDecomposer::setRounds(int rounds)
+{
+    _rounds = max(rounds, 1);
+}
+
+
+
+void
+TSPDecomposer::setRegionSize(int cities)
+{
+    _regionSize = max(cities, 1);
+}
+
+
+
+void
+TSPDecomposer::setTourRep(TSPMoveMgr::TourRep rep)
+{
+    _rep = rep;
+}
+
+
+
+void
+TSPDecomposer::setGenerateMode(TSPMoveMgr::GenerateMode mode)
+{
+    _mode = mode;
+}
+
+
+
+void
+TSPDecomposer::setMoveMix(double orOptFraction,
+                          double threeOptFraction)
+{
+    _orOptFraction = orOptFraction;
+    _threeOptFraction = threeOptFraction;
+}
+
+
+
+void
+TSPDecomposer::setTimeBudget(double seconds)
+{
+    _timeBudget = max(seconds, 0.0);
+}
+
+
+
+void
+TSPDecomposer::setCancelToken(const CancelToken* token)
+{
+    _cancel = token;
+}
+
+
+
+void
+TSPDecomposer::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+void
+TSPDecomposer::stripTour(const TSPInstance& instance,
+                         std::vector<int>&  order)
+{
+    const int     n = instance.getSize();
+    const double* x = instance.getX();
+    const double* y = instance.getY();
+    assert(x != 0);
+
+    const double minX   = *min_element(x, x + n);
+    const double maxX   = *max_element(x, x + n);
+    const int    strips = max(1, int(sqrt(n / 2.0)));
+    const double width  = max(maxX - minX, 1e-9) / strips;
+
+    order.resize(n);
+    for (int i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [=](int a, int b) {
+        const int sa = min(int((x[a] - minX) / width), strips - 1);
+        const int sb = min(int((x[b] - minX) / width), strips - 1);
+        if (sa != sb) {
+            return sa < sb;
+        }
+        return (sa & 1) ? y[a] > y[b] : y[a] < y[b];
+    });
+}
+
+
+
+bool
+TSPDecomposer::optimize(std::vector<int>& order,
+                        std::string&      error)
+{
+    // Regions with fewer cities than this aren't worth annealing.
+    const int minRegionKnob = 8;
+
+    const int n = _instance->getSize();
+    if (!_instance->hasCoords()) {
+        error = "decomposition needs an instance with coordinates";
+        return false;
+    }
+    if (int(order.size()) != n) {
+        error = "the tour doesn't have one entry per city";
+        return false;
+    }
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    unsigned int numThreads = _numThreads;
+    if (numThreads == 0) {
+        numThreads = thread::hardware_concurrency();
+    }
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+
+    const double* x = _instance->getX();
+    const double* y = _instance->getY();
+    const double  minX = *min_element(x, x + n);
+    const double  maxX = *max_element(x, x + n);
+    const double  minY = *min_element(y, y + n);
+    const double  maxY = *max_element(y, y + n);
+
+    // A square grid with about _regionSize cities per cell if they're spread
+    // evenly. Shifting it by a fraction of a cell adds a row and a column.
+    const int    side   = max(2, int(ceil(sqrt(double(n) / _regionSize))));
+    const int    cols   = side + 1;
+    const double width  = max(maxX - minX, 1e-9) / side;
+    const double height = max(maxY - minY, 1e-9) / side;
+
+    // The tour as the two neighbors of each city, which is what regions
+    // change.
+    vector<int> adj(2 * size_t(n));
+    for (int i = 0; i < n; ++i) {
+        adj[2 * order[i]] = order[i == 0 ? n - 1 : i - 1];
+        adj[2 * order[i] + 1] = order[i == n - 1 ? 0 : i + 1];
+    }
+
+    double      cost = tourCost(order);
+    vector<int> regionOf(n);
+
+    for (int round = 0; round < _rounds; ++round) {
+        if (_cancel != 0 && _cancel->isCancelled()) {
+            break;
+        }
+        const chrono::steady_clock::time_point roundStart = chrono::steady_clock::now();
+
+        // Spread the shifts of successive rounds over the cell, using the
+        // fractional parts of multiples of the two-dimensional golden ratio.
+        const double shiftX = round * 0.7548776662466927 - floor(round * 0.7548776662466927);
+        const double shiftY = round * 0.5698402909980532 - floor(round * 0.5698402909980532);
+        for (int c = 0; c < n; ++c) {
+            const int ix = min(int((x[c] - minX) / width + shiftX), cols - 1);
+            const int iy = min(int((y[c] - minY) / height + shiftY), cols - 1);
+            regionOf[c] = iy * cols + ix;
+        }
+
+        // Walk the tour from a point where it crosses from one region into
+        // another, cutting it into each region's paths.
+        int first = 0;
+        while (first < n && regionOf[order[first]] == regionOf[order[first == 0 ? n - 1 : first - 1]]) {
+            ++first;
+        }
+        if (first == n) {
+            break;                  // the whole tour is in one region
+        }
+
+        vector<Region> regions(size_t(cols) * cols);
+        for (int k = 0; k < n; ++k) {
+            const int i = (first + k) % n;
+            const int c = order[i];
+            Region&   r = regions[regionOf[c]];
+            if (k == 0 || regionOf[order[i == 0 ? n - 1 : i - 1]] != regionOf[c]) {
+                r.pathStarts.push_back(int(r.cities.size()));
+            }
+            r.cities.push_back(c);
+        }
+
+        // The biggest regions first, so that the threads finish together.
+        vector<int> queue;
+        for (size_t i = 0; i < regions.size(); ++i) {
+            regions[i].gain = 0.0;
+            if (int(regions[i].cities.size()) >= minRegionKnob) {
+                queue.push_back(int(i));
+            }
+        }
+        sort(queue.begin(), queue.end(), [&regions](int a, int b) {
+            return regions[a].cities.size() > regions[b].cities.size();
+        });
+
+        // Each region's annealer gets its share of the round's time, running
+        // numThreads at once.
+        double seconds = 0.0;
+        if (_timeBudget > 0.0) {
+            const double left = _timeBudget - chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (left <= 0.0) {
+                break;
+            }
+            const double waves = max(ceil(double(queue.size()) / numThreads), 1.0);
+            seconds = left / (_rounds - round) / waves;
+        }
+
+        atomic<size_t> next(0);
+        auto worker = [&]() {
+            for (size_t i = next++; i < queue.size(); i = next++) {
+                annealRegion(regions[queue[i]], round, _seed + round * unsigned(regions.size()) + queue[i], seconds);
+            }
+        };
+        vector<thread> threads;
+        for (unsigned int i = 1; i < min(numThreads, unsigned(queue.size())); ++i) {
+            threads.push_back(thread(worker));
+        }
+        worker();
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+
+        // Put the regions' edges back into the tour, the biggest gains first,
+        // so that those are the ones kept when regions conflict.
+        sort(queue.begin(), queue.end(), [&regions](int a, int b) {
+            return regions[a].gain > regions[b].gain;
+        });
+        double gain    = 0.0;
+        int    dropped = 0;
+        for (size_t i = 0; i < queue.size(); ++i) {
+            const Region& r = regions[queue[i]];
+            if (r.gain <= 0.0) {
+                continue;
+            }
+            if (applyRegion(r, queue[i], &regionOf[0], adj)) {
+                gain += r.gain;
+            } else {
+                ++dropped;
+            }
+        }
+        cost -= gain;
+
+        // Read the tour back off, starting from city 0.
+        int prev = -1;
+        int c    = 0;
+        for (int i = 0; i < n; ++i) {
+            order[i] = c;
+            const int following = adj[2 * c] != prev ? adj[2 * c] : adj[2 * c + 1];
+            prev = c;
+            c = following;
+        }
+
+        if (_verbose) {
+            const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            cout << "round=" << round << " regions=" << queue.size() << " dropped=" << dropped
+                 << " c=" << cost << " time=" << chrono::duration<double>(now - roundStart).count() << "\n";
+        }
+    }
+
+    if (_verbose) {
+        cout << "rounds=" << _rounds << " threads=" << numThreads
+             << " wall=" << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+             << " c=" << tourCost(order) << "\n";
+    }
+    return true;
+}
+
+
+
+// Anneal a region's cities as a TSP of their own, starting from its paths
+// joined up in order by fixed edges, which stand for the rest of the tour.
+// The fixed edges' lengths are a constant part of the cost, so the gain is
+// the same as in the whole tour.
+void
+TSPDecomposer::annealRegion(Region&      region,
+                            int          round,
+                            unsigned int seed,
+                            double       seconds) const
+{
+    // Later rounds start from a tour that's already been annealed, so only
+    // warm it up enough to fix the seams.
+    const double firstAcceptRatioKnob = 0.8;
+    const double laterAcceptRatioKnob = 0.2;
+
+    const int m = int(region.cities.size());
+
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->initSubset(_instance->getName(), *_instance, region.cities);
+
+    vector<int> order(m);
+    for (int i = 0; i < m; ++i) {
+        order[i] = i;
+    }
+
+    const int             paths = int(region.pathStarts.size());
+    vector<pair<int, int> > fixed;
+    for (int p = 0; p < paths; ++p) {
+        const int end       = (p + 1 < paths ? region.pathStarts[p + 1] : m) - 1;
+        const int nextStart = p + 1 < paths ? region.pathStarts[p + 1] : 0;
+        fixed.push_back(make_pair(end, nextStart));
+    }
+
+    TSPMoveMgr moveMgr(instance, order, _rep);
+    moveMgr.setGenerateMode(_mode);
+    moveMgr.setMoveMix(_orOptFraction, _threeOptFraction);
+    moveMgr.setFixedEdges(fixed);
+    moveMgr.seed(seed);
+
+    Annealer<TSPMove, double, TSPMoveMgr> annealer(seed);
+    annealer.setVerbose(false);
+    annealer.setStartTempMethod(Annealer<TSPMove, double, TSPMoveMgr>::SampledTemp,
+                                round == 0 ? firstAcceptRatioKnob : laterAcceptRatioKnob);
+    if (round > 0) {
+        annealer.setRequiredImprovement(0.0);
+    }
+    annealer.setTimeBudget(seconds);
+    annealer.setCancelToken(_cancel);
+    annealer.setKeepBest(true);
+
+    const double before = moveMgr.getScore();
+    annealer.optimize(&moveMgr);
+    region.gain = before - moveMgr.getScore();
+    if (region.gain > 0.0) {
+        moveMgr.getTour(region.result);
+    }
+}
+
+
+
+// Replace the region's edges in adj with those of its annealed cycle, less
+// the fixed edges. Returns false, leaving adj as it was, if that would split
+// the tour.
+bool
+TSPDecomposer::applyRegion(const Region&     region,
+                           const int         id,
+                           const int*        regionOf,
+                           std::vector<int>& adj) const
+{
+    const int m     = int(region.cities.size());
+    const int paths = int(region.pathStarts.size());
+
+    // Each path's ends, and the fixed edges between paths, by index into
+    // region.cities; a path of one city is its own other end.
+    vector<int> otherEnd(m, -1);
+    vector<int> fixedTo(2 * size_t(m), -1);
+    for (int p = 0; p < paths; ++p) {
+        const int start     = region.pathStarts[p];
+        const int end       = (p + 1 < paths ? region.pathStarts[p + 1] : m) - 1;
+        const int nextStart = p + 1 < paths ? region.pathStarts[p + 1] : 0;
+        otherEnd[start] = end;
+        otherEnd[end] = start;
+        fixedTo[2 * end + (fixedTo[2 * end] < 0 ? 0 : 1)] = nextStart;
+        fixedTo[2 * nextStart + (fixedTo[2 * nextStart] < 0 ? 0 : 1)] = end;
+    }
+
+    // The new paths are the stretches of the cycle between fixed edges. If
+    // they join the same ends as the old ones, the tour stays one cycle. The
+    // cycle is gone round twice so that the stretch through its start is
+    // checked too.
+    const vector<int>& cycle = region.result;
+    bool sameEnds = true;
+    int  pathStart = -1;
+    for (int i = 0; i < 2 * m; ++i) {
+        const int a = cycle[i % m];
+        const int b = cycle[(i + 1) % m];
+        if (fixedTo[2 * a] == b || fixedTo[2 * a + 1] == b) {
+            if (pathStart >= 0 && otherEnd[pathStart] != a) {
+                sameEnds = false;
+            }
+            pathStart = b;
+        }
+    }
+
+    vector<int> saved(2 * size_t(m));
+    for (int i = 0; i < m; ++i) {
+        const int c = region.cities[i];
+        saved[2 * i] = adj[2 * c];
+        saved[2 * i + 1] = adj[2 * c + 1];
+
+        // keep only the edges leaving the region
+        int kept = 0;
+        for (int k = 0; k < 2; ++k) {
+            if (regionOf[saved[2 * i + k]] != id) {
+                adj[2 * c + kept++] = saved[2 * i + k];
+            }
+        }
+        for (int k = kept; k < 2; ++k) {
+            adj[2 * c + k] = -1;
+        }
+    }
+    for (int i = 0; i < m; ++i) {
+        const int a = cycle[i];
+        const int b = cycle[(i + 1) % m];
+        if (fixedTo[2 * a] == b || fixedTo[2 * a + 1] == b) {
+            continue;
+        }
+        const int ca = region.cities[a];
+        const int cb = region.cities[b];
+        adj[2 * ca + (adj[2 * ca] < 0 ? 0 : 1)] = cb;
+        adj[2 * cb + (adj[2 * cb] < 0 ? 0 : 1)] = ca;
+    }
+
+    if (sameEnds || isSingleCycle(adj)) {
+        return true;
+    }
+
+    for (int i = 0; i < m; ++i) {
+        const int c = region.cities[i];
+        adj[2 * c] = saved[2 * i];
+        adj[2 * c + 1] = saved[2 * i + 1];
+    }
+    return false;
+}
+
+
+
+bool
+TSPDecomposer::isSingleCycle(const std::vector<int>& adj)
+{
+    const int n    = int(adj.size() / 2);
+    int       prev = -1;
+    int       c    = 0;
+    for (int i = 1; i < n; ++i) {
+        const int following = adj[2 * c] != prev ? adj[2 * c] : adj[2 * c + 1];
+        prev = c;
+        c = following;
+        if (c == 0) {
+            return false;
+        }
+    }
+    return adj[2 * c] == 0 || adj[2 * c + 1] == 0;
+}
+
+
+
+double
+TSPDecomposer::tourCost(const std::vector<int>& order) const
+{
+    const int n    = int(order.size());
+    double    cost = 0.0;
+    for (int i = 0; i < n; ++i) {
+        cost += _instance->dist(order[i], order[i == n - 1 ? 0 : i + 1]);
+    }
+    return cost;
+}
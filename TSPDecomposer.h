@@ -0,0 +1,119 @@
+// Parallel annealing of large TSP instances by spatial decomposition
+
+#if !defined(TSPDECOMPOSER_H)
+#define TSPDECOMPOSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CancelToken.h"
+#include "TSPInstance.h"
+#include "TSPMoveMgr.h"
+
+
+
+//******************************************************************************
+// TSPDecomposer
+//
+// Anneals a tour of millions of cities on all cores, which a single chain
+// can't do. Each round cuts the plane into a grid of regions of about the
+// same number of cities. The tour passes through a region as a number of
+// paths, and each region is annealed on its own thread as a small TSP of its
+// cities, with the paths' ends held in place: the tour outside the region
+// becomes a fixed edge from each path's end to the next path's start (see
+// TSPMoveMgr::setFixedEdges), so whatever the region's annealer does, it
+// changes only the edges inside the region.
+//
+// The regions' new edges are then put back into the tour one region at a
+// time. A region that kept its paths between the same ends can't break up the
+// tour whatever the others did; one whose annealer joined the ends up
+// differently is checked, and dropped if it would split the tour into
+// several cycles given the regions already put back. The next round shifts
+// the grid, so that the seams between regions are in the middle of a region
+// and get annealed too.
+//
+// The regions are independent, so with enough of them the speedup is close
+// to the number of cores, and the whole run takes time about linear in the
+// number of cities.
+//******************************************************************************
+class TSPDecomposer {
+  public:
+    // A thread count of 0 means one thread per hardware thread.
+    TSPDecomposer(std::shared_ptr<const TSPInstance> instance,
+                  unsigned int                       numThreads = 0,
+                  unsigned int                       seed       = 5241999);
+
+    // Improve the tour, given as the cities in order. The instance must have
+    // coordinates. On failure, returns false and describes the problem in
+    // error.
+    bool                    optimize(std::vector<int>& order,
+                                     std::string&      error);
+
+    // A tour to start from when there's no better one: the cities sorted
+    // into vertical strips about sqrt(n / 2) wide, going up one strip and
+    // down the next. It passes through each region in a few long paths,
+    // where an arbitrary tour would cut a region into hundreds of short
+    // ones and leave its annealer little to work with.
+    static void             stripTour(const TSPInstance& instance,
+                                      std::vector<int>&  order);
+
+    // The number of rounds (default 4), and the number of cities per region
+    // to aim for (default 10000).
+    void                    setRounds(int rounds);
+    void                    setRegionSize(int cities);
+
+    // How the regions' move managers represent the tour and generate moves;
+    // see TSPMoveMgr.
+    void                    setTourRep(TSPMoveMgr::TourRep rep);
+    void                    setGenerateMode(TSPMoveMgr::GenerateMode mode);
+    void                    setMoveMix(double orOptFraction,
+                                       double threeOptFraction);
+
+    // Finish all the rounds within this many seconds, or 0 (the default)
+    // for no limit; each round's annealers get an equal share of what's
+    // left. Stop as soon as possible once the token, which the caller
+    // continues to own, is cancelled.
+    void                    setTimeBudget(double seconds);
+    void                    setCancelToken(const CancelToken* token);
+
+    // A line per round is written to stdout unless this is turned off.
+    void                    setVerbose(bool verbose);
+
+  private:
+    // One region of a round, and what its annealer made of it.
+    struct Region {
+        std::vector<int>    cities;         // its paths in tour order, one after another
+        std::vector<int>    pathStarts;     // where each path starts in cities
+        std::vector<int>    result;         // the annealed cycle, as indexes into cities
+        double              gain;
+    };
+
+    void                    annealRegion(Region&      region,
+                                         int          round,
+                                         unsigned int seed,
+                                         double       seconds) const;
+    bool                    applyRegion(const Region&     region,
+                                        const int         id,
+                                        const int*        regionOf,
+                                        std::vector<int>& adj) const;
+    static bool             isSingleCycle(const std::vector<int>& adj);
+    double                  tourCost(const std::vector<int>& order) const;
+
+    std::shared_ptr<const TSPInstance> _instance;
+    unsigned int            _numThreads;
+    unsigned int            _seed;
+    int                     _rounds;
+    int                     _regionSize;
+    TSPMoveMgr::TourRep     _rep;
+    TSPMoveMgr::GenerateMode _mode;
+    double                  _orOptFraction;
+    double                  _threeOptFraction;
+    double                  _timeBudget;
+    const CancelToken*      _cancel;
+    bool                    _verbose;
+};
+
+
+
+#endif
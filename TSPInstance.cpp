@@ -0,0 +1,1023 @@
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Checkpoint.h"
+#include "TSPInstance.h"
+
+using namespace std;
+
+
+
+// A cache file is a CacheHeader, the name and then the path of the TSPLIB
+// file it was parsed from, each padded with zeros to a multiple of 8 bytes,
+// the x and then the y coordinates as doubles if there are any, and the
+// packed triangle of weights if the instance is EXPLICIT, all in the
+// machine's own byte order.
+const char      cacheMagic[8]   = { 'O', 'P', 'T', 'T', 'S', 'P', 'C', '\0' };
+const uint32_t  cacheVersion    = 2;
+
+struct CacheHeader {
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                weightType;
+    int32_t                 size;
+    uint32_t                matrixBits;     // 0 for no weights, 16 or 32
+    uint32_t                hasCoords;
+    uint32_t                nameLength;
+    uint32_t                sourceLength;
+    uint32_t                unused;
+    uint64_t                sourceSize;     // of the TSPLIB file, when parsed
+    int64_t                 sourceTime;     // its modification time
+};
+
+
+
+//******************************************************************************
+// MappedFile
+//
+// A read-only memory mapping of a whole file, unmapped on destruction.
+//******************************************************************************
+class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    bool                    open(const std::string& filename,
+                                 std::string&       error);
+
+    const char*             begin() const { return _data; }
+    const char*             end() const   { return _data + _length; }
+
+    // Tell the OS the mapping will be read in no particular order, rather
+    // than from start to end.
+    void                    adviseRandom() const;
+
+  private:
+    MappedFile(const MappedFile&);              // not implemented
+    MappedFile&             operator=(const MappedFile&);
+
+    const char*             _data;
+    size_t                  _length;
+#if defined(_WIN32)
+    HANDLE                  _file;
+    HANDLE                  _mapping;
+#endif
+};
+
+
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile()
+:   _data(0),
+    _length(0),
+    _file(INVALID_HANDLE_VALUE),
+    _mapping(0)
+{
+}
+
+
+
+MappedFile::~MappedFile()
+{
+    if (_data != 0) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping != 0) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+}
+
+
+
+bool
+MappedFile::open(const std::string& filename,
+                 std::string&       error)
+{
+    _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (_file == INVALID_HANDLE_VALUE) {
+        error = "can't open " + filename;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        error = filename + " is empty";
+        return false;
+    }
+    _length = size_t(size.QuadPart);
+
+    _mapping = CreateFileMappingA(_file, 0, PAGE_READONLY, 0, 0, 0);
+    if (_mapping != 0) {
+        _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (_data == 0) {
+        error = "can't map " + filename;
+        return false;
+    }
+
+    return true;
+}
+
+
+
+void
+MappedFile::adviseRandom() const
+{
+}
+
+#else
+
+MappedFile::MappedFile()
+:   _data(0),
+    _length(0)
+{
+}
+
+
+
+MappedFile::~MappedFile()
+{
+    if (_data != 0) {
+        munmap(const_cast<char*>(_data), _length);
+    }
+}
+
+
+
+bool
+MappedFile::open(const std::string& filename,
+                 std::string&       error)
+{
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "can't open " + filename + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        error = filename + " is empty";
+        return false;
+    }
+    _length = size_t(st.st_size);
+
+    void* data = mmap(0, _length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        error = "can't map " + filename + ": " + strerror(errno);
+        return false;
+    }
+    madvise(data, _length, MADV_SEQUENTIAL);
+    _data = static_cast<const char*>(data);
+
+    return true;
+}
+
+
+
+void
+MappedFile::adviseRandom() const
+{
+    madvise(const_cast<char*>(_data), _length, MADV_RANDOM);
+}
+
+#endif
+
+
+
+// The size and modification time of a file, or false if there's no such
+// file.
+static bool
+fileStamp(const std::string& filename,
+          uint64_t&          size,
+          int64_t&           modified)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    modified = (int64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    size = uint64_t(st.st_size);
+    modified = int64_t(st.st_mtime);
+#endif
+    return true;
+}
+
+
+
+// Skip spaces, tabs and line breaks.
+static inline void
+skipSpace(const char*& p,
+          const char*  end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        ++p;
+    }
+}
+
+
+
+// Parse the next whitespace-delimited number.
+template<class T>
+static inline bool
+parseNumber(const char*& p,
+            const char*  end,
+            T&           value)
+{
+    skipSpace(p, end);
+    if (p < end && *p == '+') {
+        ++p;
+    }
+    const from_chars_result r = from_chars(p, end, value);
+    if (r.ec != errc() || (r.ptr < end && !isspace((unsigned char)(*r.ptr)))) {
+        return false;
+    }
+    p = r.ptr;
+    return true;
+}
+
+
+
+// Return the next line with leading and trailing whitespace removed, and
+// advance past it.
+static string
+nextLine(const char*& p,
+         const char*  end)
+{
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (eol == 0) {
+        eol = end;
+    }
+
+    const char* b = p;
+    const char* e = eol;
+    while (b < e && isspace((unsigned char)(*b))) {
+        ++b;
+    }
+    while (e > b && isspace((unsigned char)(e[-1]))) {
+        --e;
+    }
+
+    p = eol < end ? eol + 1 : end;
+    return string(b, e);
+}
+
+
+
+static string
+trim(const string& s)
+{
+    const size_t b = s.find_first_not_of(" \t\r");
+    if (b == string::npos) {
+        return string();
+    }
+    const size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+
+
+TSPInstance::TSPInstance()
+:   _size(0),
+    _weightType(Euc2D),
+    _matrix16(0),
+    _matrix32(0),
+    _sourceSize(0),
+    _sourceTime(0)
+{
+}
+
+
+
+bool
+TSPInstance::load(const std::string& filename,
+                  std::string&       error)
+{
+    const shared_ptr<MappedFile> file(new MappedFile);
+    if (!file->open(filename, error)) {
+        return false;
+    }
+
+    const bool cached = size_t(file->end() - file->begin()) >= sizeof(cacheMagic) &&
+                        equal(cacheMagic, cacheMagic + sizeof(cacheMagic), file->begin());
+    if (!(cached ? parseCache(file, error) : parse(file->begin(), file->end(), error))) {
+        error = filename + ": " + error;
+        return false;
+    }
+    if (!cached) {
+        _source = filename;
+        fileStamp(filename, _sourceSize, _sourceTime);
+    }
+
+    return true;
+}
+
+
+
+bool
+TSPInstance::loadCache(const std::string& cacheFile,
+                       const std::string& source,
+                       std::string&       error)
+{
+    uint64_t size;
+    int64_t  modified;
+    if (!fileStamp(source, size, modified)) {
+        error = "can't find " + source;
+        return false;
+    }
+
+    const shared_ptr<MappedFile> file(new MappedFile);
+    if (!file->open(cacheFile, error)) {
+        return false;
+    }
+    if (size_t(file->end() - file->begin()) < sizeof(cacheMagic) ||
+        !equal(cacheMagic, cacheMagic + sizeof(cacheMagic), file->begin())) {
+        error = cacheFile + ": not a cache";
+        return false;
+    }
+    if (!parseCache(file, error)) {
+        error = cacheFile + ": " + error;
+        return false;
+    }
+
+    if (_source != source) {
+        error = cacheFile + " is a cache of " + (_source.empty() ? string("no file") : _source) + ", not " + source;
+    } else if (_sourceSize != size || _sourceTime != modified) {
+        error = source + " has changed since " + cacheFile + " was written";
+    } else {
+        return true;
+    }
+    clear();
+    return false;
+}
+
+
+
+bool
+TSPInstance::saveCache(const std::string& filename,
+                       std::string&       error) const
+{
+    if (!_fileIndex.empty()) {
+        error = "can't cache a renumbered instance";
+        return false;
+    }
+
+    CacheHeader header;
+    copy(cacheMagic, cacheMagic + sizeof(cacheMagic), header.magic);
+    header.version = cacheVersion;
+    header.weightType = uint32_t(_weightType);
+    header.size = _size;
+    header.matrixBits = _matrix16 != 0 ? 16 : _matrix32 != 0 ? 32 : 0;
+    header.hasCoords = hasCoords() ? 1 : 0;
+    header.nameLength = uint32_t(_name.size());
+    header.sourceLength = uint32_t(_source.size());
+    header.unused = 0;
+    header.sourceSize = _sourceSize;
+    header.sourceTime = _sourceTime;
+
+    // Written under a temporary name and then renamed, like a checkpoint, so
+    // that a crash leaves either the old cache or the new one.
+    const string temp = filename + ".tmp";
+    {
+        ofstream out(temp.c_str(), ios::binary);
+        if (!out) {
+            error = "can't open " + temp + " for writing";
+            return false;
+        }
+
+        saveValue(out, header);
+        const char padding[8] = { 0 };
+        out.write(_name.data(), _name.size());
+        out.write(padding, (8 - _name.size() % 8) % 8);
+        out.write(_source.data(), _source.size());
+        out.write(padding, (8 - _source.size() % 8) % 8);
+        if (hasCoords()) {
+            out.write(reinterpret_cast<const char*>(&_x[0]), _x.size() * sizeof(double));
+            out.write(reinterpret_cast<const char*>(&_y[0]), _y.size() * sizeof(double));
+        }
+        const size_t entries = size_t(_size) * (_size - 1) / 2;
+        if (_matrix16 != 0) {
+            out.write(reinterpret_cast<const char*>(_matrix16), entries * sizeof(uint16_t));
+        } else if (_matrix32 != 0) {
+            out.write(reinterpret_cast<const char*>(_matrix32), entries * sizeof(int32_t));
+        }
+        if (!out.flush()) {
+            error = "error writing " + temp;
+            return false;
+        }
+    }
+
+    // rename() won't replace an existing file on Windows.
+    remove(filename.c_str());
+    if (rename(temp.c_str(), filename.c_str()) != 0) {
+        error = "can't rename " + temp + " to " + filename;
+        return false;
+    }
+
+    return true;
+}
+
+
+
+bool
+TSPInstance::loadTour(const std::string& filename,
+                      std::vector<int>&  order,
+                      std::string&       error) const
+{
+    MappedFile file;
+    if (!file.open(filename, error)) {
+        return false;
+    }
+
+    if (!parseTour(file.begin(), file.end(), order, error)) {
+        error = filename + ": " + error;
+        return false;
+    }
+
+    return true;
+}
+
+
+
+void
+TSPInstance::init(const std::string&         name,
+                  const std::vector<double>& x,
+                  const std::vector<double>& y)
+{
+    assert(x.size() == y.size());
+
+    clear();
+    _name = name;
+    _size = int(x.size());
+    _x = x;
+    _y = y;
+    makePoints();
+}
+
+
+
+void
+TSPInstance::initSubset(const std::string&      name,
+                        const TSPInstance&      parent,
+                        const std::vector<int>& cities)
+{
+    clear();
+    _name = name;
+    _size = int(cities.size());
+    _weightType = parent._weightType;
+
+    for (int i = 0; i < _size; ++i) {
+        const int c = cities[i];
+        if (!parent._x.empty()) {
+            _x.push_back(parent._x[c]);
+            _y.push_back(parent._y[c]);
+        }
+        if (!parent._lat.empty()) {
+            _lat.push_back(parent._lat[c]);
+            _lon.push_back(parent._lon[c]);
+        }
+    }
+
+    if (parent._matrix) {
+        vector<int32_t> lower;
+        lower.reserve(size_t(_size) * (_size - 1) / 2);
+        for (int i = 1; i < _size; ++i) {
+            for (int j = 0; j < i; ++j) {
+                lower.push_back(int32_t(parent.dist(cities[i], cities[j])));
+            }
+        }
+        setMatrix(lower);
+    }
+    makePoints();
+}
+
+
+
+void
+TSPInstance::hilbertOrder(std::vector<int>& order) const
+{
+    // The curve runs through a grid of 2^order by 2^order cells over the
+    // bounding box; cities in the same cell keep their relative order.
+    const int curveOrder = 16;
+
+    order.resize(_size);
+    if (_x.empty()) {
+        for (int c = 0; c < _size; ++c) {
+            order[c] = c;
+        }
+        return;
+    }
+
+    const double minX  = *min_element(_x.begin(), _x.end());
+    const double maxX  = *max_element(_x.begin(), _x.end());
+    const double minY  = *min_element(_y.begin(), _y.end());
+    const double maxY  = *max_element(_y.begin(), _y.end());
+    const int    cells = 1 << curveOrder;
+    const double scale = (cells - 1) / max(max(maxX - minX, maxY - minY), 1e-300);
+
+    vector<pair<long long, int> > keys(_size);
+    for (int c = 0; c < _size; ++c) {
+        int       x = int((_x[c] - minX) * scale);
+        int       y = int((_y[c] - minY) * scale);
+        long long d = 0;
+        for (int s = cells / 2; s > 0; s /= 2) {
+            const int rx = (x & s) != 0;
+            const int ry = (y & s) != 0;
+            d += (long long)(s) * s * ((3 * rx) ^ ry);
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = cells - 1 - x;
+                    y = cells - 1 - y;
+                }
+                swap(x, y);
+            }
+        }
+        keys[c] = make_pair(d, c);
+    }
+    sort(keys.begin(), keys.end());
+
+    for (int i = 0; i < _size; ++i) {
+        order[i] = keys[i].second;
+    }
+}
+
+
+
+void
+TSPInstance::renumberHilbert()
+{
+    if (_x.empty()) {
+        return;
+    }
+
+    vector<int> order;
+    hilbertOrder(order);
+
+    vector<double> x(_size);
+    vector<double> y(_size);
+    vector<int>    fileIndex(_size);
+    for (int i = 0; i < _size; ++i) {
+        const int c = order[i];
+        x[i] = _x[c];
+        y[i] = _y[c];
+        fileIndex[i] = getFileIndex(c);
+    }
+    _x.swap(x);
+    _y.swap(y);
+    _fileIndex.swap(fileIndex);
+
+    if (!_lat.empty()) {
+        vector<double> lat(_size);
+        vector<double> lon(_size);
+        for (int i = 0; i < _size; ++i) {
+            lat[i] = _lat[order[i]];
+            lon[i] = _lon[order[i]];
+        }
+        _lat.swap(lat);
+        _lon.swap(lon);
+    }
+
+    makePoints();
+}
+
+
+
+void
+TSPInstance::clear()
+{
+    _size = 0;
+    _weightType = Euc2D;
+    _x.clear();
+    _y.clear();
+    _points.clear();
+    _lat.clear();
+    _lon.clear();
+    _matrix.reset();
+    _matrix16 = 0;
+    _matrix32 = 0;
+    _fileIndex.clear();
+    _source.clear();
+    _sourceSize = 0;
+    _sourceTime = 0;
+}
+
+
+
+// GEO coordinates are DDD.MM degrees and minutes. Convert them to radians
+// the way TSPLIB does, truncating to get the degrees.
+void
+TSPInstance::convertGeo()
+{
+    const double pi = 3.141592;
+
+    _lat.resize(_size);
+    _lon.resize(_size);
+    for (int i = 0; i < _size; ++i) {
+        const double latDeg = double(int(_x[i]));
+        const double lonDeg = double(int(_y[i]));
+        _lat[i] = pi * (latDeg + 5.0 * (_x[i] - latDeg) / 3.0) / 180.0;
+        _lon[i] = pi * (lonDeg + 5.0 * (_y[i] - lonDeg) / 3.0) / 180.0;
+    }
+}
+
+
+
+void
+TSPInstance::makePoints()
+{
+    _points.resize(_x.size());
+    for (size_t i = 0; i < _x.size(); ++i) {
+        _points[i].x = Coord(_x[i]);
+        _points[i].y = Coord(_y[i]);
+    }
+}
+
+
+
+// Take the packed lower triangle of weights, narrowing it to 16 bits if
+// they all fit. lower is left empty.
+void
+TSPInstance::setMatrix(std::vector<int32_t>& lower)
+{
+    bool narrow = true;
+    for (size_t k = 0; k < lower.size(); ++k) {
+        if (lower[k] < 0 || lower[k] > 65535) {
+            narrow = false;
+            break;
+        }
+    }
+
+    if (narrow) {
+        const shared_ptr<vector<uint16_t> > m(new vector<uint16_t>(lower.begin(), lower.end()));
+        _matrix = shared_ptr<const void>(m, m->data());
+        _matrix16 = m->data();
+        _matrix32 = 0;
+        lower.clear();
+    } else {
+        const shared_ptr<vector<int32_t> > m(new vector<int32_t>);
+        m->swap(lower);
+        _matrix = shared_ptr<const void>(m, m->data());
+        _matrix16 = 0;
+        _matrix32 = m->data();
+    }
+}
+
+
+
+// Parse a TSPLIB file: a header of "KEYWORD : value" lines, followed by data
+// sections introduced by a line containing just the section name.
+bool
+TSPInstance::parse(const char*  p,
+                   const char*  end,
+                   std::string& error)
+{
+    clear();
+
+    bool   gotWeightType = false;
+    string weightFormat;
+    int    lineNum = 0;
+
+    while (p < end) {
+        const string line = nextLine(p, end);
+        ++lineNum;
+        if (line.empty()) {
+            continue;
+        }
+
+        const size_t colon = line.find(':');
+        const string key   = trim(line.substr(0, colon));
+        const string value = colon == string::npos ? string() : trim(line.substr(colon + 1));
+        const string where = " on line " + to_string(lineNum);
+
+        if (key == "NAME") {
+            _name = value;
+        } else if (key == "COMMENT" || key == "DISPLAY_DATA_TYPE") {
+            // ignored
+        } else if (key == "TYPE") {
+            if (value != "TSP") {
+                error = "unsupported TYPE " + value + where;
+                return false;
+            }
+        } else if (key == "DIMENSION") {
+            const char* v = value.c_str();
+            if (!parseNumber(v, v + value.size(), _size) || _size < 1) {
+                error = "bad DIMENSION" + where;
+                return false;
+            }
+        } else if (key == "EDGE_WEIGHT_TYPE") {
+            if (value == "EUC_2D") {
+                _weightType = Euc2D;
+            } else if (value == "CEIL_2D") {
+                _weightType = Ceil2D;
+            } else if (value == "ATT") {
+                _weightType = Att;
+            } else if (value == "GEO") {
+                _weightType = Geo;
+            } else if (value == "EXPLICIT") {
+                _weightType = Explicit;
+            } else {
+                error = "unsupported EDGE_WEIGHT_TYPE " + value + where;
+                return false;
+            }
+            gotWeightType = true;
+        } else if (key == "EDGE_WEIGHT_FORMAT") {
+            weightFormat = value;
+        } else if (key == "NODE_COORD_TYPE") {
+            if (value != "TWOD_COORDS") {
+                error = "unsupported NODE_COORD_TYPE " + value + where;
+                return false;
+            }
+        } else if (key == "NODE_COORD_SECTION" || key == "DISPLAY_DATA_SECTION") {
+            if (_size == 0) {
+                error = key + " before DIMENSION" + where;
+                return false;
+            }
+
+            // Display data is only used for drawing pictures, but we read it
+            // anyway to get past it. So are an EXPLICIT instance's node
+            // coordinates, which needn't agree with its weights; they're
+            // dropped below, once the weight type is certain.
+            const char*    start = p;
+            vector<double> x(_size);
+            vector<double> y(_size);
+            vector<char>   seen(_size, 0);
+            for (int i = 0; i < _size; ++i) {
+                int    index;
+                double xi;
+                double yi;
+                if (!parseNumber(p, end, index) || !parseNumber(p, end, xi) || !parseNumber(p, end, yi)) {
+                    error = "bad or missing coordinates for city " + to_string(i + 1) + " in " + key;
+                    return false;
+                }
+                if (index < 1 || index > _size || seen[index - 1]) {
+                    error = "bad or repeated city number " + to_string(index) + " in " + key;
+                    return false;
+                }
+                seen[index - 1] = 1;
+                x[index - 1] = xi;
+                y[index - 1] = yi;
+            }
+            if (key == "NODE_COORD_SECTION") {
+                _x.swap(x);
+                _y.swap(y);
+            }
+            lineNum += int(count(start, p, '\n'));
+        } else if (key == "EDGE_WEIGHT_SECTION") {
+            if (_size == 0 || !gotWeightType || _weightType != Explicit) {
+                error = "EDGE_WEIGHT_SECTION without DIMENSION and EDGE_WEIGHT_TYPE EXPLICIT" + where;
+                return false;
+            }
+            const bool full  = weightFormat == "FULL_MATRIX";
+            const bool upper = weightFormat == "UPPER_ROW" || weightFormat == "UPPER_DIAG_ROW";
+            const bool lower = weightFormat == "LOWER_ROW" || weightFormat == "LOWER_DIAG_ROW";
+            const bool diag  = weightFormat == "UPPER_DIAG_ROW" || weightFormat == "LOWER_DIAG_ROW";
+            if (!full && !upper && !lower) {
+                error = "unsupported EDGE_WEIGHT_FORMAT " + weightFormat + where;
+                return false;
+            }
+
+            // Row i of the section has the weights (i, first) to (i, last).
+            // Diagonal weights are read and ignored; a full matrix's weights
+            // above the diagonal are checked against those below.
+            const char*     start = p;
+            vector<int32_t> triangle(size_t(_size) * (_size - 1) / 2);
+            size_t          parsed = 0;
+            for (int i = 0; i < _size; ++i) {
+                const int first = upper ? (diag ? i : i + 1) : 0;
+                const int last  = lower ? (diag ? i : i - 1) : _size - 1;
+                for (int j = first; j <= last; ++j) {
+                    int32_t weight;
+                    if (!parseNumber(p, end, weight)) {
+                        error = "bad or missing edge weight " + to_string(parsed + 1) + " in EDGE_WEIGHT_SECTION";
+                        return false;
+                    }
+                    ++parsed;
+                    if (i == j) {
+                        continue;
+                    }
+                    int32_t& entry = i > j ? triangle[size_t(i) * (i - 1) / 2 + j] : triangle[size_t(j) * (j - 1) / 2 + i];
+                    if (full && j < i && weight != entry) {
+                        error = "edge weights " + to_string(i + 1) + "-" + to_string(j + 1) + " and " +
+                                to_string(j + 1) + "-" + to_string(i + 1) + " differ in EDGE_WEIGHT_SECTION";
+                        return false;
+                    }
+                    entry = weight;
+                }
+            }
+            setMatrix(triangle);
+            lineNum += int(count(start, p, '\n'));
+        } else if (key == "EOF") {
+            break;
+        } else {
+            error = "unsupported keyword " + key + where;
+            return false;
+        }
+    }
+
+    if (_size < 4) {
+        error = "need a DIMENSION of at least 4";
+        return false;
+    }
+    if (_weightType == Explicit ? !_matrix : _x.empty()) {
+        error = _weightType == Explicit ? "missing EDGE_WEIGHT_SECTION" : "missing NODE_COORD_SECTION";
+        return false;
+    }
+    if (_weightType == Explicit) {
+        _x.clear();
+        _y.clear();
+    }
+
+    if (_weightType == Geo) {
+        convertGeo();
+    }
+
+    makePoints();
+    return true;
+}
+
+
+
+// Load a cache written by saveCache(), copying the coordinates but reading
+// the weights in place from the mapping, which the instance keeps open.
+bool
+TSPInstance::parseCache(const std::shared_ptr<const MappedFile>& file,
+                        std::string&                             error)
+{
+    clear();
+
+    const size_t length = size_t(file->end() - file->begin());
+    CacheHeader  header;
+    if (length < sizeof(header)) {
+        error = "truncated cache";
+        return false;
+    }
+    memcpy(&header, file->begin(), sizeof(header));
+    if (header.version != cacheVersion) {
+        error = "unsupported cache version, or a cache from a machine of the other byte order";
+        return false;
+    }
+    if (header.size < 4 || header.weightType > uint32_t(Explicit) ||
+        (header.weightType == uint32_t(Explicit)) != (header.matrixBits != 0) ||
+        (header.matrixBits != 0 && header.matrixBits != 16 && header.matrixBits != 32) ||
+        (header.weightType != uint32_t(Explicit)) != (header.hasCoords != 0)) {
+        error = "corrupt cache header";
+        return false;
+    }
+
+    const size_t n       = size_t(header.size);
+    const size_t source  = sizeof(header) + (size_t(header.nameLength) + 7) / 8 * 8;
+    const size_t coords  = source + (size_t(header.sourceLength) + 7) / 8 * 8;
+    const size_t weights = coords + (header.hasCoords ? 2 * n * sizeof(double) : 0);
+    if (length != weights + n * (n - 1) / 2 * (header.matrixBits / 8)) {
+        error = "truncated or corrupt cache";
+        return false;
+    }
+
+    _name.assign(file->begin() + sizeof(header), header.nameLength);
+    _source.assign(file->begin() + source, header.sourceLength);
+    _sourceSize = header.sourceSize;
+    _sourceTime = header.sourceTime;
+    _size = header.size;
+    _weightType = WeightType(header.weightType);
+    if (header.hasCoords) {
+        const double* x = reinterpret_cast<const double*>(file->begin() + coords);
+        _x.assign(x, x + n);
+        _y.assign(x + n, x + 2 * n);
+    }
+    if (header.matrixBits != 0) {
+        const void* m = file->begin() + weights;
+        _matrix = shared_ptr<const void>(file, m);
+        if (header.matrixBits == 16) {
+            _matrix16 = static_cast<const uint16_t*>(m);
+        } else {
+            _matrix32 = static_cast<const int32_t*>(m);
+        }
+        file->adviseRandom();
+    }
+
+    if (_weightType == Geo) {
+        convertGeo();
+    }
+
+    makePoints();
+    return true;
+}
+
+
+
+// Parse a TSPLIB tour file: a header like an instance's, then a TOUR_SECTION
+// of 1-based city numbers ended by -1. The tour must visit every city of this
+// instance exactly once.
+bool
+TSPInstance::parseTour(const char*       p,
+                       const char*       end,
+                       std::vector<int>& order,
+                       std::string&      error) const
+{
+    order.clear();
+
+    int lineNum = 0;
+    while (p < end) {
+        const string line = nextLine(p, end);
+        ++lineNum;
+        if (line.empty()) {
+            continue;
+        }
+
+        const size_t colon = line.find(':');
+        const string key   = trim(line.substr(0, colon));
+        const string value = colon == string::npos ? string() : trim(line.substr(colon + 1));
+        const string where = " on line " + to_string(lineNum);
+
+        if (key == "NAME" || key == "COMMENT") {
+            // ignored
+        } else if (key == "TYPE") {
+            if (value != "TOUR") {
+                error = "unsupported TYPE " + value + where;
+                return false;
+            }
+        } else if (key == "DIMENSION") {
+            const char* v = value.c_str();
+            int         size;
+            if (!parseNumber(v, v + value.size(), size) || size != _size) {
+                error = "DIMENSION doesn't match the instance's " + to_string(_size) + where;
+                return false;
+            }
+        } else if (key == "TOUR_SECTION") {
+            vector<int> cityOf(_size);
+            for (int i = 0; i < _size; ++i) {
+                cityOf[getFileIndex(i)] = i;
+            }
+            vector<char> seen(_size, 0);
+            order.reserve(_size);
+            for (;;) {
+                int city;
+                skipSpace(p, end);
+                if (p == end) {
+                    break;
+                }
+                if (!parseNumber(p, end, city)) {
+                    error = "bad city number after " + to_string(order.size()) + " in TOUR_SECTION";
+                    return false;
+                }
+                if (city == -1) {
+                    break;
+                }
+                if (city < 1 || city > _size || seen[city - 1]) {
+                    error = "bad or repeated city number " + to_string(city) + " in TOUR_SECTION";
+                    return false;
+                }
+                seen[city - 1] = 1;
+                order.push_back(cityOf[city - 1]);
+            }
+            break;
+        } else if (key == "EOF") {
+            break;
+        } else {
+            error = "unsupported keyword " + key + where;
+            return false;
+        }
+    }
+
+    if (int(order.size()) != _size) {
+        error = "the tour has " + to_string(order.size()) + " cities, not " + to_string(_size);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,284 @@
+// Problem data for the symmetric TSP, as read from a TSPLIB file
+
+#if !defined(TSPINSTANCE_H)
+#define TSPINSTANCE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdint.h>
+
+
+
+class MappedFile;
+
+
+
+//******************************************************************************
+// TSPInstance
+//
+// The cities of a TSP instance and the distance between them. This is
+// immutable once loaded, so move managers working on the same instance (e.g.
+// clones running on separate threads) share one copy of it.
+//
+// The loader maps the file into memory and parses it in place, so it handles
+// multi-million-city files quickly. It understands the TSPLIB edge weight
+// types EUC_2D, CEIL_2D, ATT, GEO and EXPLICIT (with EDGE_WEIGHT_FORMAT
+// FULL_MATRIX, UPPER_ROW, LOWER_ROW, UPPER_DIAG_ROW or LOWER_DIAG_ROW).
+// Distances follow the TSPLIB definitions, except that EUC_2D distances are
+// not rounded to the nearest integer.
+//
+// An EXPLICIT instance's weights are kept as the lower triangle of the
+// matrix, without the diagonal, packed row by row: n(n - 1)/2 entries of 16
+// bits if every weight fits, or of 32 bits if not. A 10,000-city road network
+// takes 100MB rather than the 400MB of a full matrix of ints. Parsing that
+// many numbers takes a while, so an instance can be saved to a binary cache
+// file, which load() recognizes and maps into memory as it is, reading the
+// weights straight out of the mapping.
+//
+// Distances are computed from a copy of the coordinates with each city's x
+// and y side by side, so that looking up a city touches one cache line. Built
+// with OPTIMIZER_FLOAT_COORDS defined, the copy is in floats, half the size;
+// integer coordinates up to 2^24 are still exact, but others are rounded to
+// about 7 significant digits.
+//******************************************************************************
+class TSPInstance {
+  public:
+#if defined(OPTIMIZER_FLOAT_COORDS)
+    typedef float           Coord;
+#else
+    typedef double          Coord;
+#endif
+
+    struct Point {
+        Coord               x;
+        Coord               y;
+    };
+
+    enum WeightType {
+        Euc2D,
+        Ceil2D,
+        Att,
+        Geo,
+        Explicit
+    };
+
+    TSPInstance();
+
+    // Load a TSPLIB file, or a cache written by saveCache(). On failure,
+    // returns false and describes the problem in error.
+    bool                    load(const std::string& filename,
+                                 std::string&       error);
+
+    // Load a cache written by saveCache(), but only if it was made from the
+    // TSPLIB file source as that file is now: the cache records the path it
+    // was loaded by, and the file's size and modification time. On failure,
+    // including a cache that's out of date, returns false and describes the
+    // problem in error.
+    bool                    loadCache(const std::string& cacheFile,
+                                      const std::string& source,
+                                      std::string&       error);
+
+    // Write the instance to a binary cache file, in this machine's byte
+    // order; a cache from a machine of the other byte order is rejected.
+    // Renumbered instances can't be cached. On failure, returns false and
+    // describes the problem in error.
+    bool                    saveCache(const std::string& filename,
+                                      std::string&       error) const;
+
+    // Make an EUC_2D instance from the given coordinates, which are copied.
+    void                    init(const std::string&         name,
+                                 const std::vector<double>& x,
+                                 const std::vector<double>& y);
+
+    // Make an instance of the given cities of another one, with the same
+    // weight type; city i here is city cities[i] there.
+    void                    initSubset(const std::string&      name,
+                                       const TSPInstance&      parent,
+                                       const std::vector<int>& cities);
+
+    // The cities in the order a Hilbert curve through the bounding box
+    // visits them, or in numerical order if there are no coordinates.
+    void                    hilbertOrder(std::vector<int>& order) const;
+
+    // Renumber the cities in Hilbert curve order, so that cities near each
+    // other in the plane are mostly near each other in memory too, and the
+    // cities a move looks at share cache lines and pages. Does nothing to an
+    // instance without coordinates. Call it before any move manager is made
+    // for the instance.
+    void                    renumberHilbert();
+
+    // The city's number in the file, counting from 0, which differs from
+    // its number here once the cities have been renumbered.
+    int                     getFileIndex(const int city) const;
+
+    // Load a TSPLIB tour file for this instance, giving the cities in tour
+    // order, numbered from 0 (as renumbered, if they have been). On failure,
+    // returns false and describes the problem in error.
+    bool                    loadTour(const std::string& filename,
+                                     std::vector<int>&  order,
+                                     std::string&       error) const;
+
+    const std::string&      getName() const;
+    int                     getSize() const;
+    WeightType              getWeightType() const;
+
+    // Whether the cities have coordinates. EXPLICIT instances don't, even
+    // if the file gives some, in which case getX() and getY() return 0.
+    bool                    hasCoords() const;
+    const double*           getX() const;
+    const double*           getY() const;
+    const Point*            getPoints() const;
+
+    double                  dist(const int i, const int j) const;
+
+  private:
+    void                    clear();
+    bool                    parse(const char*  p,
+                                  const char*  end,
+                                  std::string& error);
+    bool                    parseCache(const std::shared_ptr<const MappedFile>& file,
+                                       std::string&                             error);
+    bool                    parseTour(const char*       p,
+                                      const char*       end,
+                                      std::vector<int>& order,
+                                      std::string&      error) const;
+    void                    convertGeo();
+    void                    makePoints();
+    void                    setMatrix(std::vector<int32_t>& lower);
+
+    std::string             _name;
+    int                     _size;
+    WeightType              _weightType;
+    std::vector<double>     _x;
+    std::vector<double>     _y;
+    std::vector<Point>      _points;    // _x and _y interleaved, for dist()
+    std::vector<double>     _lat;       // GEO only, in radians
+    std::vector<double>     _lon;
+    std::shared_ptr<const void> _matrix;    // EXPLICIT only: the packed lower triangle, in memory or mapped
+    const uint16_t*         _matrix16;  // _matrix, if its entries are 16 bits
+    const int32_t*          _matrix32;  // _matrix, if its entries are 32 bits
+    std::vector<int>        _fileIndex; // empty unless renumbered
+    std::string             _source;    // the TSPLIB file parsed, if any, for caches
+    uint64_t                _sourceSize;
+    int64_t                 _sourceTime;
+};
+
+
+
+inline const std::string&
+TSPInstance::getName() const
+{
+    return _name;
+}
+
+
+
+inline int
+TSPInstance::getSize() const
+{
+    return _size;
+}
+
+
+
+inline TSPInstance::WeightType
+TSPInstance::getWeightType() const
+{
+    return _weightType;
+}
+
+
+
+inline bool
+TSPInstance::hasCoords() const
+{
+    return !_x.empty();
+}
+
+
+
+inline const double*
+TSPInstance::getX() const
+{
+    return _x.empty() ? 0 : &_x[0];
+}
+
+
+
+inline const double*
+TSPInstance::getY() const
+{
+    return _y.empty() ? 0 : &_y[0];
+}
+
+
+
+inline const TSPInstance::Point*
+TSPInstance::getPoints() const
+{
+    return _points.empty() ? 0 : &_points[0];
+}
+
+
+
+inline int
+TSPInstance::getFileIndex(const int city) const
+{
+    return _fileIndex.empty() ? city : _fileIndex[city];
+}
+
+
+
+inline double
+TSPInstance::dist(const int i,
+                  const int j) const
+{
+    switch (_weightType) {
+      case Euc2D: {
+        const double dx = double(_points[i].x) - _points[j].x;
+        const double dy = double(_points[i].y) - _points[j].y;
+        return sqrt(dx * dx + dy * dy);
+      }
+
+      case Ceil2D: {
+        const double dx = double(_points[i].x) - _points[j].x;
+        const double dy = double(_points[i].y) - _points[j].y;
+        return ceil(sqrt(dx * dx + dy * dy));
+      }
+
+      case Att: {
+        // pseudo-Euclidean distance, rounded up
+        const double dx = double(_points[i].x) - _points[j].x;
+        const double dy = double(_points[i].y) - _points[j].y;
+        const double r  = sqrt((dx * dx + dy * dy) / 10.0);
+        const double t  = floor(r + 0.5);
+        return t < r ? t + 1.0 : t;
+      }
+
+      case Geo: {
+        // great circle distance in km on the TSPLIB idealized sphere
+        const double rrr = 6378.388;
+        const double q1  = cos(_lon[i] - _lon[j]);
+        const double q2  = cos(_lat[i] - _lat[j]);
+        const double q3  = cos(_lat[i] + _lat[j]);
+        return floor(rrr * acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+      }
+
+      case Explicit:
+      default: {
+        // (i, j) for i > j is entry i(i - 1)/2 + j of the packed triangle
+        if (i == j) {
+            return 0.0;
+        }
+        const size_t k = i > j ? size_t(i) * (i - 1) / 2 + j : size_t(j) * (j - 1) / 2 + i;
+        return _matrix16 != 0 ? double(_matrix16[k]) : double(_matrix32[k]);
+      }
+    }
+}
+
+
+
+#endif
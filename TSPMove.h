@@ -7,13 +7,57 @@
 
 
 
+// A move on a TSP tour. Rather than a class per kind of move, which would mean
+// a virtual call or an allocation per move, there's one small class with a tag
+// saying which kind it is, so the optimizers can keep moves on the stack and in
+// arrays. The fields mean:
+//
+//   TwoOpt     remove the edges after _a and after _b, and reconnect the tour
+//              by reversing the path between them.
+//   OrOpt      move the segment of at most three cities after _a, up to and
+//              including _b, to between _c and the city after it, reversing
+//              it if _reversed is set.
+//   ThreeOpt   the same with a segment of any length, never reversed. This
+//              is the 3-opt move that removes the edges after _a, _b and _c
+//              and swaps the two paths between them without reversing
+//              either, sometimes called or-3opt.
+//
+// _a, _b and _c, where used, are in tour order.
+//
+// Every kind has an O(1) delta, but none is O(1) to make. Making an OrOpt
+// move on the array tour shifts the cities between the segment and _c, or
+// the rest of the tour if that's fewer, so it's O(n) in the worst case like
+// a 2-opt flip; on the two-level tour it's O(sqrt(n)). A ThreeOpt move is
+// made as three 2-opt flips.
+//
+// A 2-opt move made from a nearest-neighbor list also carries, in _cached,
+// where the move manager keeps the length of the neighbor edge it adds: the
+// edge (_a,_b), or the edge from the city after _a to the city after _b if
+// _cachedNext is set. Otherwise _cached is -1. Like the move itself, that's
+// only good for the tour the move was generated on.
 class TSPMove {
   public:
+    enum Kind {
+        TwoOpt,
+        OrOpt,
+        ThreeOpt
+    };
+
     TSPMove(int a = 0,
             int b = 0);
+    TSPMove(Kind kind,
+            int  a,
+            int  b,
+            int  c,
+            bool reversed = false);
 
-    int _a;
-    int _b;
+    Kind _kind;
+    int  _a;
+    int  _b;
+    int  _c;
+    bool _reversed;
+    bool _cachedNext;
+    int  _cached;
 };
 
 
@@ -21,12 +65,34 @@ class TSPMove {
 inline
 TSPMove::TSPMove(int a,
                  int b)
-:   _a(a),
-    _b(b)
+:   _kind(TwoOpt),
+    _a(a),
+    _b(b),
+    _c(0),
+    _reversed(false),
+    _cachedNext(false),
+    _cached(-1)
 {
 }
 
 
 
-#endif
+inline
+TSPMove::TSPMove(Kind kind,
+                 int  a,
+                 int  b,
+                 int  c,
+                 bool reversed)
+:   _kind(kind),
+    _a(a),
+    _b(b),
+    _c(c),
+    _reversed(reversed),
+    _cachedNext(false),
+    _cached(-1)
+{
+}
+
 
+
+#endif
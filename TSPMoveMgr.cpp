@@ -1,13 +1,29 @@
 #include <algorithm>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <math.h>
 #include <assert.h>
 
+#if defined(__AVX2__) || defined(__AVX512F__)
+// GCC 12 warns that the gathers' and sqrt's placeholder source operand, which
+// is deliberately left undefined, may be used uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#include "Checkpoint.h"
 #include "IOptimizer.h"
+#include "SpatialGrid.h"
 #include "TSPMove.h"
 #include "TSPMoveMgr.h"
 
@@ -15,205 +31,530 @@ using namespace std;
 
 
 
-TSPMoveMgr::TSPMoveMgr(const std::string& filename)
-:   _size(0)
+template<class CostType>
+TSPMoveMgrT<CostType>::TSPMoveMgrT(std::shared_ptr<const TSPInstance> instance,
+                                   TourRep                            rep)
+:   _instance(instance),
+    _size(instance->getSize()),
+    _rep(rep),
+    _mode(UniformGen),
+    _numNeighbors(0),
+    _orOptFraction(0.0),
+    _threeOptFraction(0.0)
 {
-    // Read the TSP instance. This will fail non-gracefully on the instances that
-    // are not specified as a set of points.
-    ifstream in(filename.c_str());
-    bool gotCoords = false;
-    while (!gotCoords) {
-        string token;
-        in >> token;
-        if (token.substr(0, 9) == "DIMENSION") {
-            in >> token;
-            if (token == ":") {
-                in >> _size;
-            } else {
-                _size = atol(token.c_str());
-            }
-            assert(_size > 2);
-            cerr << "Got DIMENSION: " << _size << endl;
-        } else if (token.substr(0, 4) == "NAME") {
-            in >> token;
-            if (token == ":") {
-                in >> _name;
-            } else {
-                _name = token;
+    assert(_size > 3);
+
+    buildNeighbors(10);
+
+    // create an arbitrary tour
+    vector<int> order(_size);
+    for (int i = 0; i < _size; ++i) {
+        order[i] = i;
+    }
+    setTour(order);
+}
+
+
+
+template<class CostType>
+TSPMoveMgrT<CostType>::TSPMoveMgrT(std::shared_ptr<const TSPInstance> instance,
+                                   const std::vector<int>&            order,
+                                   TourRep                            rep)
+:   _instance(instance),
+    _size(instance->getSize()),
+    _rep(rep),
+    _mode(UniformGen),
+    _numNeighbors(0),
+    _orOptFraction(0.0),
+    _threeOptFraction(0.0)
+{
+    assert(_size > 3 && int(order.size()) == _size);
+
+    buildNeighbors(10);
+    setTour(order);
+}
+
+
+
+template<class CostType>
+TSPMoveMgrT<CostType>::TSPMoveMgrT(const TSPMoveMgrT& other)
+:   _instance(other._instance),
+    _size(other._size),
+    _rep(other._rep),
+    _arrayTour(other._arrayTour),
+    _twoLevelTour(other._twoLevelTour),
+    _cost(other._cost),
+    _mode(other._mode),
+    _numNeighbors(other._numNeighbors),
+    _orOptFraction(other._orOptFraction),
+    _threeOptFraction(other._threeOptFraction),
+    _neighbors(other._neighbors),
+    _neighborDists(other._neighborDists),
+    _fixed(other._fixed),
+    _rand(other._rand)
+{
+}
+
+
+
+template<class CostType>
+TSPMoveMgrT<CostType>::~TSPMoveMgrT()
+{
+}
+
+
+
+#if defined(__AVX512F__)
+
+// Eight Euclidean distances at once, between cities i[k] and j[k]. The
+// coordinates are interleaved, so city c's are 2c elements from x and y.
+static inline __m512d
+dist8(const TSPInstance::Coord* x,
+      const TSPInstance::Coord* y,
+      const int*                i,
+      const int*                j)
+{
+    const __m256i vi = _mm256_slli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(i)), 1);
+    const __m256i vj = _mm256_slli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(j)), 1);
+#if defined(OPTIMIZER_FLOAT_COORDS)
+    const __m512d dx = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_i32gather_ps(x, vi, 4)),
+                                     _mm512_cvtps_pd(_mm256_i32gather_ps(x, vj, 4)));
+    const __m512d dy = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_i32gather_ps(y, vi, 4)),
+                                     _mm512_cvtps_pd(_mm256_i32gather_ps(y, vj, 4)));
+#else
+    const __m512d dx = _mm512_sub_pd(_mm512_i32gather_pd(vi, x, 8), _mm512_i32gather_pd(vj, x, 8));
+    const __m512d dy = _mm512_sub_pd(_mm512_i32gather_pd(vi, y, 8), _mm512_i32gather_pd(vj, y, 8));
+#endif
+    return _mm512_sqrt_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+}
+
+#elif defined(__AVX2__)
+
+// Four Euclidean distances at once, between cities i[k] and j[k]. The
+// coordinates are interleaved, so city c's are 2c elements from x and y.
+static inline __m256d
+dist4(const TSPInstance::Coord* x,
+      const TSPInstance::Coord* y,
+      const int*                i,
+      const int*                j)
+{
+    const __m128i vi = _mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(i)), 1);
+    const __m128i vj = _mm_slli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(j)), 1);
+#if defined(OPTIMIZER_FLOAT_COORDS)
+    const __m256d dx = _mm256_sub_pd(_mm256_cvtps_pd(_mm_i32gather_ps(x, vi, 4)),
+                                     _mm256_cvtps_pd(_mm_i32gather_ps(x, vj, 4)));
+    const __m256d dy = _mm256_sub_pd(_mm256_cvtps_pd(_mm_i32gather_ps(y, vi, 4)),
+                                     _mm256_cvtps_pd(_mm_i32gather_ps(y, vj, 4)));
+#else
+    const __m256d dx = _mm256_sub_pd(_mm256_i32gather_pd(x, vi, 8), _mm256_i32gather_pd(x, vj, 8));
+    const __m256d dy = _mm256_sub_pd(_mm256_i32gather_pd(y, vi, 8), _mm256_i32gather_pd(y, vj, 8));
+#endif
+    return _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+}
+
+#endif
+
+
+
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::proposeMoves(const TSPMove* moves,
+                                    CostType*      deltas,
+                                    size_t         n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        deltas[i] = proposeMove(&moves[i]);
+    }
+}
+
+
+
+// On EUC_2D instances built with AVX2 or AVX-512 enabled, look up the four
+// cities of each move and then compute the deltas 4 or 8 moves at a time.
+// Everything else, including any group of moves that aren't all 2-opt, falls
+// back to proposeMove.
+template<>
+void
+TSPMoveMgrT<double>::proposeMoves(const TSPMove* moves,
+                                  double*        deltas,
+                                  size_t         n)
+{
+    size_t i = 0;
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#if defined(__AVX512F__)
+    const size_t width = 8;
+#else
+    const size_t width = 4;
+#endif
+    if (_instance->getWeightType() == TSPInstance::Euc2D) {
+        const TSPInstance::Coord* x = &_instance->getPoints()->x;
+        const TSPInstance::Coord* y = &_instance->getPoints()->y;
+        int a[width];
+        int aNext[width];
+        int b[width];
+        int bNext[width];
+        for (; i + width <= n; i += width) {
+            bool twoOpt = true;
+            for (size_t k = 0; k < width; ++k) {
+                twoOpt &= moves[i + k]._kind == TSPMove::TwoOpt;
             }
-            cerr << "Got NAME: " << _name << endl;
-        } else if (token == "NODE_COORD_SECTION") {
-            cerr << "Begin NODE_COORD_SECTION" << endl;
-            assert(_size > 0);
-
-            _x = new double[_size];
-            _y = new double[_size];
-            for (int i = 0; i < _size; ++i) {
-                int index;
-                double x;
-                double y;
-                in >> index >> x >> y;
-                assert(index >= 1 && index <= _size);
-                _x[index - 1] = double(x);
-                _y[index - 1] = double(y);
+            if (!twoOpt) {
+                for (size_t k = 0; k < width; ++k) {
+                    deltas[i + k] = proposeMove(&moves[i + k]);
+                }
+                continue;
             }
-            in >> token;
-            assert(token == "EOF");
 
-            cerr << "Done NODE_COORD_SECTION" << endl;
-
-            gotCoords = true;
+            for (size_t k = 0; k < width; ++k) {
+                a[k] = moves[i + k]._a;
+                aNext[k] = succ(a[k]);
+                b[k] = moves[i + k]._b;
+                bNext[k] = succ(b[k]);
+            }
+#if defined(__AVX512F__)
+            const __m512d newedges = _mm512_add_pd(dist8(x, y, a, b), dist8(x, y, aNext, bNext));
+            const __m512d oldedges = _mm512_add_pd(dist8(x, y, a, aNext), dist8(x, y, b, bNext));
+            _mm512_storeu_pd(deltas + i, _mm512_sub_pd(newedges, oldedges));
+#else
+            const __m256d newedges = _mm256_add_pd(dist4(x, y, a, b), dist4(x, y, aNext, bNext));
+            const __m256d oldedges = _mm256_add_pd(dist4(x, y, a, aNext), dist4(x, y, b, bNext));
+            _mm256_storeu_pd(deltas + i, _mm256_sub_pd(newedges, oldedges));
+#endif
         }
     }
-    in.close();
+#endif
 
-    assert(gotCoords);
+    for (; i < n; ++i) {
+        deltas[i] = proposeMove(&moves[i]);
+    }
+}
 
 
-    // create an arbitrary tour
-    _tour = new int[_size];
+
+template<class CostType>
+CostType
+TSPMoveMgrT<CostType>::computeScore() const
+{
+    CostType cost = 0;
     for (int i = 0; i < _size; ++i) {
-        _tour[i] = next(i);
+        cost += dist(i, succ(i));
     }
 
-    _cost = computeScore();
+    return cost;
+}
 
-    // DEBUG
-    cerr << "initial tour:\n";
-    for (int i = 0, n = 0; i < _size; ++i, n = _tour[n]) {
-        cerr << n << " ";
-    }
-    cerr << endl;
-    cerr << "cost=" << _cost << endl;
+
+
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::seed(unsigned int seed)
+{
+    _rand.seed(seed);
 }
 
 
 
-TSPMoveMgr::~TSPMoveMgr()
+template<class CostType>
+TSPMoveMgrT<CostType>*
+TSPMoveMgrT<CostType>::clone() const
 {
-    delete[] _x;
-    delete[] _y;
+    return new TSPMoveMgrT(*this);
 }
 
 
 
+// The instance is the same for every copy, so only the tour and its cost
+// need to be transferred.
+template<class CostType>
 void
-TSPMoveMgr::generateMove(TSPMove* move)
+TSPMoveMgrT<CostType>::copyState(const IMoveMgr<TSPMove, CostType>* other)
 {
-    // pick a random pair that are different and not neighbors
-    do {
-        move->_a = rand() % _size;
-        move->_b = rand() % _size;
-    } while (move->_a == move->_b || _tour[move->_a] == move->_b || _tour[move->_b] == move->_a);
+    const TSPMoveMgrT* src = static_cast<const TSPMoveMgrT*>(other);
+    assert(src->_instance == _instance && src->_rep == _rep);
+
+    _arrayTour = src->_arrayTour;
+    _twoLevelTour = src->_twoLevelTour;
+    _cost = src->_cost;
 }
 
 
 
-double
-TSPMoveMgr::proposeMove(const TSPMove* move)
+// The neighbor lists are sorted nearest first, so once a neighbor is no
+// nearer than the tour edge being removed, no later one can give a gain
+// through that edge either; this is the usual neighbor list pruning of 2-opt.
+// For the edge to the successor, the move (a,b) replaces (a,succ(a)) with
+// (a,b); for the edge to the predecessor, (pred(a),pred(b)) replaces
+// (pred(a),a) with (a,b).
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::candidateMoves(int                   city,
+                                      std::vector<TSPMove>& moves)
 {
-    const int a = move->_a;
-    const int aNext = _tour[move->_a];
-    const int b = move->_b;
-    const int bNext = _tour[move->_b];
+    moves.clear();
+
+    const int       a         = city;
+    const int       aNext     = succ(a);
+    const int       aPrev     = pred(a);
+    const CostType  nextDist  = dist(a, aNext);
+    const CostType  prevDist  = dist(a, aPrev);
+    const int*      neighbors = &(*_neighbors)[size_t(a) * _numNeighbors];
+    const CostType* distances = &(*_neighborDists)[size_t(a) * _numNeighbors];
+
+    for (int i = 0; i < _numNeighbors; ++i) {
+        const int      b = neighbors[i];
+        const CostType d = distances[i];
+        if (d >= nextDist && d >= prevDist) {
+            break;
+        }
 
-    // the edges (a,aNext) and (b,bNext) will be removed and replaced with
-    // the edges (a,b) and (aNext,bNext)
-    const double newedges = L2Dist(_x[a], _y[a], _x[b], _y[b])
-                          + L2Dist(_x[aNext], _y[aNext], _x[bNext], _y[bNext]);
-    const double oldedges = L2Dist(_x[a], _y[a], _x[aNext], _y[aNext])
-                          + L2Dist(_x[b], _y[b], _x[bNext], _y[bNext]);
+        const int slot = a * _numNeighbors + i;
+        if (d < nextDist && b != aNext && succ(b) != a) {
+            moves.push_back(TSPMove(a, b));
+            moves.back()._cached = slot;
+        }
+
+        const int bPrev = pred(b);
+        if (d < prevDist && b != aPrev && bPrev != a && aPrev != bPrev) {
+            moves.push_back(TSPMove(aPrev, bPrev));
+            moves.back()._cached = slot;
+            moves.back()._cachedNext = true;
+        }
+    }
 
-    return newedges - oldedges;
+    if (!_fixed.empty()) {
+        size_t kept = 0;
+        for (size_t i = 0; i < moves.size(); ++i) {
+            if (!removesFixedEdge(&moves[i])) {
+                moves[kept++] = moves[i];
+            }
+        }
+        moves.resize(kept);
+    }
+}
+
+
+
+// The cities whose tour edges the move changes.
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::touchedElements(const TSPMove*    move,
+                                       std::vector<int>& cities)
+{
+    cities.clear();
+    cities.push_back(move->_a);
+    cities.push_back(succ(move->_a));
+    cities.push_back(move->_b);
+    cities.push_back(succ(move->_b));
+    if (move->_kind != TSPMove::TwoOpt) {
+        cities.push_back(move->_c);
+        cities.push_back(succ(move->_c));
+    }
+}
+
+
+
+// The tour is saved as the cities in order from city 0, so a checkpoint can
+// be restored into a move manager with either representation.
+template<class CostType>
+bool
+TSPMoveMgrT<CostType>::saveState(std::ostream& out) const
+{
+    vector<int> order;
+    getTour(order);
+
+    saveValue(out, int32_t(_size));
+    saveValue(out, _cost);
+    saveValue(out, _rand);
+    saveVector(out, order);
+
+    return bool(out);
 }
 
 
 
-// FIX cache the last proposal
-double
-TSPMoveMgr::makeMove(const TSPMove* move)
+template<class CostType>
+bool
+TSPMoveMgrT<CostType>::restoreState(std::istream& in,
+                                    std::string&  error)
 {
-    // compute the move's cost
-    const double delta = proposeMove(move);
-    _cost += delta;
+    int32_t     size;
+    CostType    cost;
+    Random      rand;
+    vector<int> order;
+    if (!loadValue(in, size) || !loadValue(in, cost) || !loadValue(in, rand)) {
+        error = "truncated or corrupt tour";
+        return false;
+    }
+    if (size != _size) {
+        error = "the checkpoint is of a " + to_string(size) + "-city tour, not " + to_string(_size);
+        return false;
+    }
+    if (!loadVector(in, order, uint64_t(_size)) || int(order.size()) != _size) {
+        error = "truncated or corrupt tour";
+        return false;
+    }
 
-    // modify the tour to implement the move. this involves removing the edges
-    // (a,aNext) and (b,bNext), adding the edges (a,b) and (aNext,bNext), and
-    // reversing the section of the tour between aNext and bNext.
-    const int a = move->_a;
-    const int aNext = _tour[move->_a];
-    const int b = move->_b;
-    const int bNext = _tour[move->_b];
-    int x = aNext;
-    int n1 = _tour[x];
-    while (n1 != bNext) {
-        const int n2 = _tour[n1];
-        _tour[n1] = x;
-        x = n1;
-        n1 = n2;
+    vector<char> seen(_size, 0);
+    for (int i = 0; i < _size; ++i) {
+        if (order[i] < 0 || order[i] >= _size || seen[order[i]]) {
+            error = "the checkpointed tour isn't a permutation of the cities";
+            return false;
+        }
+        seen[order[i]] = 1;
     }
-    _tour[a] = b;
-    _tour[aNext] = bNext;
 
-    return delta;
+    setTour(order);
+    _cost = cost;
+    _rand = rand;
+
+    return true;
 }
 
 
 
-double
-TSPMoveMgr::getScore()
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::setGenerateMode(GenerateMode mode,
+                                       int          numNeighbors)
 {
-    return _cost;
+    _mode = mode;
+    if (numNeighbors != _numNeighbors) {
+        buildNeighbors(numNeighbors);
+    }
 }
 
 
 
-double
-TSPMoveMgr::computeScore() const
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::setMoveMix(double orOptFraction,
+                                  double threeOptFraction)
 {
-    double cost = 0.0;
-    for (int i = 0; i < _size; ++i) {
-        const int j = _tour[i];
-        cost += L2Dist(_x[i], _y[i], _x[j], _y[j]);
+    assert(orOptFraction >= 0.0 && threeOptFraction >= 0.0 && orOptFraction + threeOptFraction <= 1.0);
+
+    _orOptFraction = orOptFraction;
+    _threeOptFraction = threeOptFraction;
+}
+
+
+
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::setFixedEdges(const std::vector<std::pair<int, int> >& edges)
+{
+    _fixed.clear();
+    if (edges.empty()) {
+        return;
     }
 
-    return cost;
+    _fixed.resize(2 * size_t(_size), -1);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const int a = edges[i].first;
+        const int b = edges[i].second;
+        assert(succ(a) == b || pred(a) == b);
+
+        int* const aSlot = &_fixed[2 * a + (_fixed[2 * a] < 0 ? 0 : 1)];
+        int* const bSlot = &_fixed[2 * b + (_fixed[2 * b] < 0 ? 0 : 1)];
+        assert(*aSlot < 0 && *bSlot < 0);
+        *aSlot = b;
+        *bSlot = a;
+    }
 }
 
 
 
-unsigned int
-TSPMoveMgr::getProblemSize()
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::getTour(std::vector<int>& order) const
 {
-    return _size;
+    if (_rep == TwoLevelRep) {
+        _twoLevelTour.getOrder(order);
+    } else {
+        _arrayTour.getOrder(order);
+    }
 }
 
 
 
+// Find each city's nearest neighbors using a uniform grid, or by brute force
+// if the instance has no coordinates, and cache the distance to each. The
+// lists are shared with any clones.
+template<class CostType>
 void
-TSPMoveMgr::debug()
+TSPMoveMgrT<CostType>::buildNeighbors(const int numNeighbors)
 {
-    cerr << "tour:";
-    for (int i = 0, n = 0; i < _size; ++i, n = _tour[n]) {
-        cerr << " " << n;
+    assert(numNeighbors > 0);
+
+    _numNeighbors = min(numNeighbors, _size - 1);
+    shared_ptr<vector<int> > neighbors(new vector<int>(size_t(_size) * _numNeighbors));
+
+    vector<int> nearest;
+    if (_instance->hasCoords()) {
+        const SpatialGrid grid(_instance->getX(), _instance->getY(), _size);
+        for (int c = 0; c < _size; ++c) {
+            grid.nearest(c, _numNeighbors, nearest);
+            copy(nearest.begin(), nearest.end(), neighbors->begin() + size_t(c) * _numNeighbors);
+        }
+    } else {
+        vector<pair<double, int> > row(_size - 1);
+        for (int c = 0; c < _size; ++c) {
+            for (int i = 0, j = 0; i < _size; ++i) {
+                if (i != c) {
+                    row[j++] = make_pair(dist(c, i), i);
+                }
+            }
+            partial_sort(row.begin(), row.begin() + _numNeighbors, row.end());
+            for (int i = 0; i < _numNeighbors; ++i) {
+                (*neighbors)[size_t(c) * _numNeighbors + i] = row[i].second;
+            }
+        }
     }
-    cerr << endl;
 
-    cerr << "alleged cost: " << getScore() << endl;
-    cerr << "scratch cost: " << computeScore() << endl;
+    shared_ptr<vector<CostType> > distances(new vector<CostType>(neighbors->size()));
+    for (int c = 0; c < _size; ++c) {
+        for (int i = 0; i < _numNeighbors; ++i) {
+            const size_t k = size_t(c) * _numNeighbors + i;
+            (*distances)[k] = dist(c, (*neighbors)[k]);
+        }
+    }
+
+    _neighbors = neighbors;
+    _neighborDists = distances;
 }
 
 
 
-double
-TSPMoveMgr::L2Dist(const double x0,
-                   const double y0,
-                   const double x1,
-                   const double y1)
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::setTour(const std::vector<int>& order)
 {
-    const double deltaX = abs(x0 - x1);
-    const double deltaY = abs(y0 - y1);
+    if (_rep == TwoLevelRep) {
+        _twoLevelTour.init(&order[0], _size);
+    } else {
+        _arrayTour.init(&order[0], _size);
+    }
 
-    return sqrt(deltaX * deltaX + deltaY * deltaY);
+    _cost = computeScore();
 }
 
+
+
+template<class CostType>
+void
+TSPMoveMgrT<CostType>::debug()
+{
+    cerr << "tour:";
+    for (int i = 0, n = 0; i < _size; ++i, n = succ(n)) {
+        cerr << " " << _instance->getFileIndex(n);
+    }
+    cerr << endl;
+
+    cerr << "alleged cost: " << getScore() << endl;
+    cerr << "scratch cost: " << computeScore() << endl;
+}
+
+
+
+template class TSPMoveMgrT<double>;
+template class TSPMoveMgrT<long long>;
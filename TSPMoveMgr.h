@@ -2,55 +2,541 @@
 #if !defined(TSPMOVEMGR_H)
 #define TSPMOVEMGR_H
 
+#include <algorithm>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
 #include "IOptimizer.h"
+#include "Profile.h"
+#include "Random.h"
+#include "TSPInstance.h"
 #include "TSPMove.h"
+#include "TSPTour.h"
+
+
+
+//******************************************************************************
+// TSPMoveMgrBase
+//
+// What every TSPMoveMgrT has in common whatever its cost type: the options,
+// so that TSPMoveMgr::ArrayRep and the like name the same thing for all.
+//******************************************************************************
+class TSPMoveMgrBase {
+  public:
+    // How the tour is stored. See TSPTour.h; the array is faster on small
+    // instances, and the two-level list on large ones.
+    enum TourRep {
+        ArrayRep,
+        TwoLevelRep
+    };
+
+    // How generateMove picks the pair of cities for a 2-opt move. Uniform
+    // picks both at random. Neighbor picks the first at random and the second
+    // from the first's nearest neighbors, so the new edge between them is
+    // short; most moves proposed at low temperature are then worth trying.
+    enum GenerateMode {
+        UniformGen,
+        NeighborGen
+    };
+};
 
 
 
-class TSPMoveMgr : public IMoveMgr<TSPMove, double> {
+//******************************************************************************
+// TSPMoveMgrT
+//
+// 2-opt, Or-opt and or-3opt moves (see TSPMove.h) on a symmetric TSP tour.
+// The class is final and its per-move methods are inline, so an optimizer
+// instantiated on TSPMoveMgrT itself rather than on IMoveMgr calls them
+// without virtual dispatch.
+//
+// CostType is double or long long, which TSPMoveMgr.cpp instantiates as
+// TSPMoveMgr and TSPIntMoveMgr. With doubles, distances are the instance's.
+// With long longs they're rounded to the nearest integer, as TSPLIB defines
+// them for EUC_2D (the others are integers already), so costs match
+// published optimal tour lengths, and the running cost is exactly what
+// adding up the tour gives, however many moves it's been updated by.
+//******************************************************************************
+template<class CostType>
+class TSPMoveMgrT final : public IMoveMgr<TSPMove, CostType>,
+                         public TSPMoveMgrBase {
   public:
-    TSPMoveMgr(const std::string& filename);
-    ~TSPMoveMgr();
+    // The instance is shared with any clones of this move manager. The
+    // starting tour visits the cities in numerical order, or is the given
+    // order, e.g. one from TSPInstance::loadTour, which must be a
+    // permutation of the cities.
+    TSPMoveMgrT(std::shared_ptr<const TSPInstance> instance,
+                TourRep                            rep = ArrayRep);
+    TSPMoveMgrT(std::shared_ptr<const TSPInstance> instance,
+                const std::vector<int>&            order,
+                TourRep                            rep = ArrayRep);
+    TSPMoveMgrT(const TSPMoveMgrT& other);
+    ~TSPMoveMgrT();
 
     virtual void            generateMove(TSPMove* move);
-    virtual double          proposeMove(const TSPMove* move);
-    virtual double          makeMove(const TSPMove* move);
-    virtual double          getScore();
+    virtual CostType        proposeMove(const TSPMove* move);
+    virtual void            proposeMoves(const TSPMove* moves, CostType* deltas, size_t n);
+    virtual CostType        makeMove(const TSPMove* move);
+    virtual CostType        getScore();
     virtual unsigned int    getProblemSize();
+    virtual void            seed(unsigned int seed);
+    virtual TSPMoveMgrT*    clone() const;
+    virtual void            copyState(const IMoveMgr<TSPMove, CostType>* other);
+    virtual bool            saveState(std::ostream& out) const;
+    virtual bool            restoreState(std::istream& in,
+                                         std::string&  error);
+
+    // 2-opt moves that add an edge from the city to one of its near
+    // neighbors shorter than the tour edge it replaces, nearest first.
+    virtual void            candidateMoves(int                   city,
+                                           std::vector<TSPMove>& moves);
+    virtual void            touchedElements(const TSPMove*    move,
+                                            std::vector<int>& cities);
 
     virtual void            debug();
 
+    // Select the move generation mode. The candidate lists of nearest
+    // neighbors are built at load time with the default size; asking for a
+    // different number of neighbors rebuilds them.
+    void                    setGenerateMode(GenerateMode mode,
+                                            int          numNeighbors = 10);
+
+    // The fractions of generated moves that are Or-opt and or-3opt moves;
+    // the rest are 2-opt. The default is all 2-opt. Or-opt moves are good
+    // for fixing up a nearly finished tour, since their deltas are O(1).
+    // Applying one costs about what a 2-opt move does: on the array tour it
+    // shifts the shorter side between the segment and where it goes, which
+    // can be up to n/2 cities, and on the two-level tour it's O(sqrt(n)).
+    // Or-3opt moves are applied as three 2-opt moves. In neighbor mode, each
+    // kind of move is generated so that one of the edges it adds joins a
+    // city to one of its neighbors.
+    void                    setMoveMix(double orOptFraction,
+                                       double threeOptFraction);
+
+    // Never remove these edges, given as pairs of cities that are adjacent
+    // in the tour: moves that would aren't generated, nor offered by
+    // candidateMoves. A city can be in at most two fixed edges. This is
+    // how TSPDecomposer holds the ends of a region's paths in place.
+    void                    setFixedEdges(const std::vector<std::pair<int, int> >& edges);
+
+    // The cities in tour order, starting from city 0.
+    void                    getTour(std::vector<int>& order) const;
+
   private:
-    int                     prev(const int i) const;
-    int                     next(const int i) const;
-    double                  computeScore() const;
-    static double           L2Dist(const double x0, const double y0,
-                                   const double x1, const double y1);
+    TSPMoveMgrT&            operator=(const TSPMoveMgrT&);  // not implemented
 
   private:
-    int         _size;
-    double*     _x;
-    double*     _y;
-    int*        _tour;    // _tour[i] is the next vertex after i in the tour
-    double      _cost;
-    std::string _name;
+    void                    buildNeighbors(const int numNeighbors);
+    void                    setTour(const std::vector<int>& order);
+    void                    generateTwoOpt(TSPMove* move);
+    void                    generateOrOpt(TSPMove* move);
+    void                    generateThreeOpt(TSPMove* move);
+    int                     succ(const int c) const;
+    int                     pred(const int c) const;
+    bool                    isFixed(const int a, const int b) const;
+    bool                    removesFixedEdge(const TSPMove* move) const;
+    bool                    between(const int a, const int b, const int c) const;
+    void                    flip(const int a, const int b, const int c, const int d);
+    void                    moveSegment(const int a, const int b, const int c, const bool reversed);
+    void                    exchange(const int p, const int q, const int r, const int s);
+    CostType                dist(const int i, const int j) const;
+    CostType                computeScore() const;
+
+  private:
+    std::shared_ptr<const TSPInstance> _instance;
+    int          _size;
+    TourRep      _rep;
+    ArrayTour    _arrayTour;       // only the one selected by _rep is used
+    TwoLevelTour _twoLevelTour;
+    CostType     _cost;
+    GenerateMode _mode;
+    int          _numNeighbors;
+    double       _orOptFraction;
+    double       _threeOptFraction;
+    std::shared_ptr<const std::vector<int> > _neighbors;   // (*_neighbors)[c * _numNeighbors + i] is c's i'th nearest neighbor
+    std::shared_ptr<const std::vector<CostType> > _neighborDists;  // and dist(c, that neighbor)
+    std::vector<int> _fixed;       // [2 * c] and [2 * c + 1] are c's partners in fixed edges, or -1; empty if none
+    Random       _rand;
 };
 
+typedef TSPMoveMgrT<double>    TSPMoveMgr;
+typedef TSPMoveMgrT<long long> TSPIntMoveMgr;
+
+// Batches of 2-opt moves are vectorized for double costs only.
+template<>
+void
+TSPMoveMgrT<double>::proposeMoves(const TSPMove* moves,
+                                  double*        deltas,
+                                  size_t         n);
 
 
+
+template<class CostType>
 inline int
-TSPMoveMgr::prev(const int i) const
+TSPMoveMgrT<CostType>::succ(const int c) const
 {
-    return i == 0 ? _size - 1 : i - 1;
+    return _rep == TwoLevelRep ? _twoLevelTour.next(c) : _arrayTour.next(c);
 }
 
 
 
+template<class CostType>
 inline int
-TSPMoveMgr::next(const int i) const
+TSPMoveMgrT<CostType>::pred(const int c) const
+{
+    return _rep == TwoLevelRep ? _twoLevelTour.prev(c) : _arrayTour.prev(c);
+}
+
+
+
+template<class CostType>
+inline CostType
+TSPMoveMgrT<CostType>::dist(const int i,
+                            const int j) const
+{
+    return CostType(_instance->dist(i, j));
+}
+
+
+
+// TSPLIB's nint(): distances are never negative, so adding a half and
+// truncating rounds to the nearest.
+template<>
+inline long long
+TSPMoveMgrT<long long>::dist(const int i,
+                             const int j) const
+{
+    return (long long)(_instance->dist(i, j) + 0.5);
+}
+
+
+
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::flip(const int a,
+                            const int b,
+                            const int c,
+                            const int d)
+{
+    if (_rep == TwoLevelRep) {
+        _twoLevelTour.flip(a, b, c, d);
+    } else {
+        _arrayTour.flip(a, b, c, d);
+    }
+}
+
+
+
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::moveSegment(const int  a,
+                                   const int  b,
+                                   const int  c,
+                                   const bool reversed)
+{
+    if (_rep == TwoLevelRep) {
+        _twoLevelTour.moveSegment(a, b, c, reversed);
+    } else {
+        _arrayTour.moveSegment(a, b, c, reversed);
+    }
+}
+
+
+
+template<class CostType>
+inline bool
+TSPMoveMgrT<CostType>::between(const int a,
+                               const int b,
+                               const int c) const
+{
+    return _rep == TwoLevelRep ? _twoLevelTour.between(a, b, c) : _arrayTour.between(a, b, c);
+}
+
+
+
+// Replace the edges (p,q) and (r,s) with (p,r) and (q,s), where q and s
+// follow p and r in the same direction around the tour. That's a 2-opt move
+// in whichever direction the tour now runs, since flips may have turned it
+// around.
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::exchange(const int p,
+                                const int q,
+                                const int r,
+                                const int s)
+{
+    if (succ(p) == q) {
+        flip(p, q, r, s);
+    } else {
+        flip(s, r, q, p);
+    }
+}
+
+
+
+template<class CostType>
+inline bool
+TSPMoveMgrT<CostType>::isFixed(const int a,
+                               const int b) const
+{
+    return _fixed[2 * a] == b || _fixed[2 * a + 1] == b;
+}
+
+
+
+// Whether the move would remove one of the fixed edges. Every kind of move
+// removes the edges after _a and _b, and segment moves the one after _c too.
+template<class CostType>
+inline bool
+TSPMoveMgrT<CostType>::removesFixedEdge(const TSPMove* move) const
+{
+    return isFixed(move->_a, succ(move->_a)) ||
+           isFixed(move->_b, succ(move->_b)) ||
+           (move->_kind != TSPMove::TwoOpt && isFixed(move->_c, succ(move->_c)));
+}
+
+
+
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::generateMove(TSPMove* move)
+{
+    move->_cached = -1;
+    do {
+        const double r = _orOptFraction > 0.0 || _threeOptFraction > 0.0 ? _rand.uniform() : 1.0;
+        if (r < _orOptFraction) {
+            generateOrOpt(move);
+        } else if (r < _orOptFraction + _threeOptFraction) {
+            generateThreeOpt(move);
+        } else {
+            generateTwoOpt(move);
+        }
+    } while (!_fixed.empty() && removesFixedEdge(move));
+}
+
+
+
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::generateTwoOpt(TSPMove* move)
+{
+    move->_kind = TSPMove::TwoOpt;
+
+    if (_mode == NeighborGen) {
+        // pick a random city a and one of its near neighbors b, and make the
+        // move that adds the edge (a,b). that's either the move (a,b) or the
+        // move (pred(a),pred(b)), which adds (a,b) in the other orientation.
+        // either way proposeMove can take the edge's length from the table.
+        do {
+            PROFILE_RETRY();
+            const int a    = _rand.below(_size);
+            const int slot = a * _numNeighbors + _rand.below(_numNeighbors);
+            const int b    = (*_neighbors)[slot];
+            move->_cached = slot;
+            if (_rand.next() & 1) {
+                move->_a = a;
+                move->_b = b;
+                move->_cachedNext = false;
+            } else {
+                move->_a = pred(a);
+                move->_b = pred(b);
+                move->_cachedNext = true;
+            }
+        } while (move->_a == move->_b || succ(move->_a) == move->_b || succ(move->_b) == move->_a);
+        return;
+    }
+
+    // pick a random pair that are different and not neighbors
+    do {
+        PROFILE_RETRY();
+        move->_a = _rand.below(_size);
+        move->_b = _rand.below(_size);
+    } while (move->_a == move->_b || succ(move->_a) == move->_b || succ(move->_b) == move->_a);
+}
+
+
+
+// Pick the city c to insert after and a segment of one to three cities. In
+// neighbor mode the segment starts with one of c's neighbors, or ends with
+// it if it's to be reversed, so that the new edge from c is short.
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::generateOrOpt(TSPMove* move)
+{
+    const int maxLength = std::min(3, _size - 3);
+
+    move->_kind = TSPMove::OrOpt;
+
+    for (;;) {
+        PROFILE_RETRY();
+        const int  c        = _rand.below(_size);
+        const int  x        = _mode == NeighborGen ?
+                              (*_neighbors)[size_t(c) * _numNeighbors + _rand.below(_numNeighbors)] :
+                              _rand.below(_size);
+        const int  length   = 1 + _rand.below(maxLength);
+        const bool reversed = (_rand.next() & 1) != 0;
+
+        // the segment runs forward from first to last
+        int first = x;
+        int last  = x;
+        bool hit  = c == x;
+        for (int i = 1; i < length; ++i) {
+            if (reversed) {
+                first = pred(first);
+                hit |= c == first;
+            } else {
+                last = succ(last);
+                hit |= c == last;
+            }
+        }
+
+        const int a = pred(first);
+        if (hit || c == a) {
+            continue;
+        }
+
+        move->_a = a;
+        move->_b = last;
+        move->_c = c;
+        move->_reversed = reversed;
+        return;
+    }
+}
+
+
+
+// Pick three different cities and put them in tour order. In neighbor mode
+// the second is the predecessor of one of the first's neighbors, so that the
+// new edge from the first is short, unless ordering them swaps it with the
+// third.
+template<class CostType>
+inline void
+TSPMoveMgrT<CostType>::generateThreeOpt(TSPMove* move)
+{
+    move->_kind = TSPMove::ThreeOpt;
+    move->_reversed = false;
+
+    int a;
+    int b;
+    int c;
+    do {
+        PROFILE_RETRY();
+        a = _rand.below(_size);
+        b = _mode == NeighborGen ?
+            pred((*_neighbors)[size_t(a) * _numNeighbors + _rand.below(_numNeighbors)]) :
+            _rand.below(_size);
+        c = _rand.below(_size);
+    } while (a == b || b == c || c == a);
+
+    if (!between(a, b, c)) {
+        std::swap(b, c);
+    }
+    move->_a = a;
+    move->_b = b;
+    move->_c = c;
+}
+
+
+
+template<class CostType>
+inline CostType
+TSPMoveMgrT<CostType>::proposeMove(const TSPMove* move)
+{
+    const int a = move->_a;
+    const int aNext = succ(move->_a);
+    const int b = move->_b;
+    const int bNext = succ(move->_b);
+
+    if (move->_kind == TSPMove::TwoOpt) {
+        // the edges (a,aNext) and (b,bNext) will be removed and replaced with
+        // the edges (a,b) and (aNext,bNext). a neighbor move already knows
+        // the length of one of the new edges.
+        CostType newedges;
+        if (move->_cached < 0) {
+            newedges = dist(a, b) + dist(aNext, bNext);
+        } else if (move->_cachedNext) {
+            newedges = dist(a, b) + (*_neighborDists)[move->_cached];
+        } else {
+            newedges = (*_neighborDists)[move->_cached] + dist(aNext, bNext);
+        }
+        const CostType oldedges = dist(a, aNext) + dist(b, bNext);
+
+        return newedges - oldedges;
+    }
+
+    // the edges (a,aNext), (b,bNext) and (c,cNext) will be removed. the path
+    // bNext..c then follows a, and the path aNext..b, reversed or not,
+    // follows c.
+    const int c = move->_c;
+    const int cNext = succ(move->_c);
+    const CostType oldedges = dist(a, aNext) + dist(b, bNext) + dist(c, cNext);
+    const CostType newedges = move->_reversed ?
+                              dist(a, bNext) + dist(c, b) + dist(aNext, cNext) :
+                              dist(a, bNext) + dist(c, aNext) + dist(b, cNext);
+
+    return newedges - oldedges;
+}
+
+
+
+// FIX cache the last proposal
+template<class CostType>
+inline CostType
+TSPMoveMgrT<CostType>::makeMove(const TSPMove* move)
+{
+    // compute the move's cost
+    const CostType delta = proposeMove(move);
+    _cost += delta;
+
+    const int a = move->_a;
+    const int b = move->_b;
+
+    if (move->_kind == TSPMove::TwoOpt) {
+        // modify the tour to implement the move. this involves removing the edges
+        // (a,aNext) and (b,bNext), adding the edges (a,b) and (aNext,bNext), and
+        // reversing the section of the tour between aNext and b.
+        flip(a, succ(a), b, succ(b));
+        return delta;
+    }
+
+    const int c = move->_c;
+    if (move->_kind == TSPMove::OrOpt) {
+        // take the segment aNext..b out and put it back between c and cNext
+        moveSegment(a, b, c, move->_reversed);
+        return delta;
+    }
+
+    // swap the paths X = aNext..b and Y = bNext..c by reversing X, then Y,
+    // then both together
+    const int aNext = succ(a);
+    const int bNext = succ(b);
+    const int cNext = succ(c);
+    exchange(a, aNext, b, bNext);       // a b..aNext bNext..c cNext
+    exchange(aNext, bNext, c, cNext);   // a b..aNext c..bNext cNext
+    exchange(a, b, bNext, cNext);       // a bNext..c aNext..b cNext
+
+    return delta;
+}
+
+
+
+template<class CostType>
+inline CostType
+TSPMoveMgrT<CostType>::getScore()
+{
+    return _cost;
+}
+
+
+
+template<class CostType>
+inline unsigned int
+TSPMoveMgrT<CostType>::getProblemSize()
 {
-    const int n = i + 1;
-    return n == _size ? 0 : n;
+    return _size;
 }
 
 
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assert.h>
+
+#include "Annealer.h"
+#include "CancelToken.h"
+#include "Random.h"
+#include "SpatialGrid.h"
+#include "TSPInstance.h"
+#include "TSPMove.h"
+#include "TSPMoveMgr.h"
+#include "TSPMultilevel.h"
+
+using namespace std;
+
+
+
+TSPMultilevel::TSPMultilevel(std::shared_ptr<const TSPInstance> instance,
+                             unsigned int                       seed)
+:   _instance(instance),
+    _seed(seed),
+    _coarsestSize(1000),
+    _refineAcceptRatio(0.05),
+    _rep(TSPMoveMgr::ArrayRep),
+    _mode(TSPMoveMgr::UniformGen),
+    _orOptFraction(0.0),
+    _threeOptFraction(0.0),
+    _timeBudget(0.0),
+    _cancel(0),
+    _verbose(true)
+{
+}
+
+
+
+void
+TSPMultilevel::setCoarsestSize(int cities)
+{
+    _coarsestSize = max(cities, 8);
+}
+
+
+
+void
+TSPMultilevel::setRefineAcceptRatio(double acceptRatio)
+{
+    _refineAcceptRatio = min(max(acceptRatio, 1e-6), 1.0);
+}
+
+
+
+void
+TSPMultilevel::setTourRep(TSPMoveMgr::TourRep rep)
+{
+    _rep = rep;
+}
+
+
+
+void
+TSPMultilevel::setGenerateMode(TSPMoveMgr::GenerateMode mode)
+{
+    _mode = mode;
+}
+
+
+
+void
+TSPMultilevel::setMoveMix(double orOptFraction,
+                          double threeOptFraction)
+{
+    _orOptFraction = orOptFraction;
+    _threeOptFraction = threeOptFraction;
+}
+
+
+
+void
+TSPMultilevel::setTimeBudget(double seconds)
+{
+    _timeBudget = max(seconds, 0.0);
+}
+
+
+
+void
+TSPMultilevel::setCancelToken(const CancelToken* token)
+{
+    _cancel = token;
+}
+
+
+
+void
+TSPMultilevel::setVerbose(bool verbose)
+{
+    _verbose = verbose;
+}
+
+
+
+bool
+TSPMultilevel::optimize(std::vector<int>& order,
+                        std::string&      error)
+{
+    // Stop coarsening if a level would shrink by less than this factor, as
+    // when most cities are too far apart to be matched.
+    const double minShrinkKnob = 1.5;
+
+    if (!_instance->hasCoords()) {
+        error = "multilevel annealing needs an instance with coordinates";
+        return false;
+    }
+
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // levels[0] is the instance itself; levels[i + 1] is the coarsening of
+    // levels[i].
+    vector<Level> levels(1);
+    levels[0].instance = _instance;
+    int totalCities = _instance->getSize();
+    while (levels.back().instance->getSize() > _coarsestSize) {
+        Level coarse;
+        coarsen(*levels.back().instance, _seed + unsigned(levels.size()), coarse);
+        if (coarse.instance->getSize() * minShrinkKnob > levels.back().instance->getSize()) {
+            break;
+        }
+        totalCities += coarse.instance->getSize();
+        levels.push_back(coarse);
+    }
+
+    const int coarsest = int(levels.size()) - 1;
+    vector<int> levelOrder(levels[coarsest].instance->getSize());
+    for (size_t i = 0; i < levelOrder.size(); ++i) {
+        levelOrder[i] = int(i);
+    }
+
+    for (int level = coarsest; level >= 0; --level) {
+        const chrono::steady_clock::time_point levelStart = chrono::steady_clock::now();
+        const shared_ptr<const TSPInstance>    instance   = levels[level].instance;
+
+        if (level < coarsest) {
+            vector<int> finer;
+            expand(levels[level + 1], *instance, levelOrder, finer);
+            levelOrder.swap(finer);
+        }
+        if (_cancel != 0 && _cancel->isCancelled()) {
+            continue;
+        }
+
+        // Each level's share of the budget is in proportion to its size, out
+        // of whatever's left.
+        double seconds = 0.0;
+        if (_timeBudget > 0.0) {
+            const double left = _timeBudget - chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (left <= 0.0) {
+                continue;
+            }
+            seconds = left * instance->getSize() / totalCities;
+        }
+        totalCities -= instance->getSize();
+
+        const double cost = anneal(instance, levelOrder, level < coarsest, _seed + unsigned(level), seconds);
+
+        if (_verbose) {
+            const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            cout << "level=" << level << " cities=" << instance->getSize()
+                 << " c=" << cost << " time=" << chrono::duration<double>(now - levelStart).count() << "\n";
+        }
+    }
+
+    order.swap(levelOrder);
+
+    if (_verbose) {
+        double cost = 0.0;
+        for (size_t i = 0; i < order.size(); ++i) {
+            cost += _instance->dist(order[i], order[i + 1 == order.size() ? 0 : i + 1]);
+        }
+        cout << "levels=" << levels.size()
+             << " wall=" << chrono::duration<double>(chrono::steady_clock::now() - start).count()
+             << " c=" << cost << "\n";
+    }
+    return true;
+}
+
+
+
+// Match each city with one of its nearest neighbors that's still unmatched,
+// visiting the cities in random order, and make each pair, or each city left
+// over, a city of the coarse level at the pair's midpoint.
+void
+TSPMultilevel::coarsen(const TSPInstance& fine,
+                       const unsigned int seed,
+                       Level&             coarse) const
+{
+    // How many of a city's nearest neighbors to look at for a match.
+    const int neighborsKnob = 8;
+
+    const int     n = fine.getSize();
+    const double* x = fine.getX();
+    const double* y = fine.getY();
+    assert(x != 0);
+
+    Random      rand(seed);
+    vector<int> visit(n);
+    for (int i = 0; i < n; ++i) {
+        visit[i] = i;
+    }
+    for (int i = n - 1; i > 0; --i) {
+        swap(visit[i], visit[rand.below(unsigned(i + 1))]);
+    }
+
+    SpatialGrid    grid(x, y, n);
+    vector<char>   matched(n, 0);
+    vector<int>    neighbors;
+    vector<double> cx;
+    vector<double> cy;
+    coarse.first.clear();
+    coarse.second.clear();
+
+    for (int i = 0; i < n; ++i) {
+        const int c = visit[i];
+        if (matched[c]) {
+            continue;
+        }
+        matched[c] = 1;
+
+        int mate = -1;
+        grid.nearest(c, neighborsKnob, neighbors);
+        for (size_t j = 0; j < neighbors.size(); ++j) {
+            if (!matched[neighbors[j]]) {
+                mate = neighbors[j];
+                matched[mate] = 1;
+                break;
+            }
+        }
+
+        coarse.first.push_back(c);
+        coarse.second.push_back(mate);
+        if (mate < 0) {
+            cx.push_back(x[c]);
+            cy.push_back(y[c]);
+        } else {
+            cx.push_back(0.5 * (x[c] + x[mate]));
+            cy.push_back(0.5 * (y[c] + y[mate]));
+        }
+    }
+
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init(fine.getName(), cx, cy);
+    coarse.instance = instance;
+}
+
+
+
+// Anneal the tour of one level in place, returning its cost. The coarsest
+// level is annealed from a high temperature; finer ones are warm-started
+// from the expanded tour, cold enough to keep its overall shape.
+double
+TSPMultilevel::anneal(std::shared_ptr<const TSPInstance> instance,
+                      std::vector<int>&                  order,
+                      const bool                         refine,
+                      const unsigned int                 seed,
+                      const double                       seconds) const
+{
+    const double coarsestAcceptRatioKnob = 0.8;
+
+    TSPMoveMgr moveMgr(instance, order, _rep);
+    moveMgr.setGenerateMode(_mode);
+    moveMgr.setMoveMix(_orOptFraction, _threeOptFraction);
+    moveMgr.seed(seed);
+
+    Annealer<TSPMove, double, TSPMoveMgr> annealer(seed);
+    annealer.setVerbose(false);
+    annealer.setStartTempMethod(Annealer<TSPMove, double, TSPMoveMgr>::SampledTemp,
+                                refine ? _refineAcceptRatio : coarsestAcceptRatioKnob);
+    if (refine) {
+        annealer.setRequiredImprovement(0.0);
+    }
+    annealer.setTimeBudget(seconds);
+    annealer.setCancelToken(_cancel);
+    annealer.setKeepBest(true);
+    annealer.optimize(&moveMgr);
+
+    moveMgr.getTour(order);
+    return moveMgr.getScore();
+}
+
+
+
+// Replace each coarse city in the coarse tour by the cities it stands for,
+// taking a pair's cities nearest the previous one first.
+void
+TSPMultilevel::expand(const Level&            coarse,
+                      const TSPInstance&      fine,
+                      const std::vector<int>& coarseOrder,
+                      std::vector<int>&       fineOrder)
+{
+    fineOrder.clear();
+    fineOrder.reserve(fine.getSize());
+    for (size_t i = 0; i < coarseOrder.size(); ++i) {
+        int a = coarse.first[coarseOrder[i]];
+        int b = coarse.second[coarseOrder[i]];
+        if (b >= 0 && !fineOrder.empty() && fine.dist(fineOrder.back(), b) < fine.dist(fineOrder.back(), a)) {
+            swap(a, b);
+        }
+        fineOrder.push_back(a);
+        if (b >= 0) {
+            fineOrder.push_back(b);
+        }
+    }
+    assert(int(fineOrder.size()) == fine.getSize());
+}
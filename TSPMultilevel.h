@@ -0,0 +1,107 @@
+// Multilevel annealing of large TSP instances
+
+#if !defined(TSPMULTILEVEL_H)
+#define TSPMULTILEVEL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CancelToken.h"
+#include "TSPInstance.h"
+#include "TSPMoveMgr.h"
+
+
+
+//******************************************************************************
+// TSPMultilevel
+//
+// Coarsen, anneal, refine. The cities are matched up in pairs of near
+// neighbors, each pair standing for one city at its midpoint in a coarser
+// instance of about half the size, and so on until the instance is small.
+// That one is annealed in full. Its tour is then expanded into a tour of the
+// next finer level, visiting the two cities of each pair in whichever order
+// fits the cities before them, and the expanded tour is warm-started with a
+// short anneal at a low temperature, which only has to fix up the detail the
+// coarser level couldn't see. The finest level is the instance itself.
+//
+// Finding a starting temperature and cooling from it on a million cities
+// takes billions of moves; here the full anneal is of a thousand or so
+// cities, and each finer level costs a few times its size in equilibria of
+// moves, so the whole run takes a small fraction of the moves.
+//******************************************************************************
+class TSPMultilevel {
+  public:
+    TSPMultilevel(std::shared_ptr<const TSPInstance> instance,
+                  unsigned int                       seed = 5241999);
+
+    // Find a tour, given as the cities in order. The instance must have
+    // coordinates. On failure, returns false and describes the problem in
+    // error.
+    bool                    optimize(std::vector<int>& order,
+                                     std::string&      error);
+
+    // Stop coarsening once a level has at most this many cities (default
+    // 1000).
+    void                    setCoarsestSize(int cities);
+
+    // Each finer level's anneal starts at the temperature at which about
+    // this fraction of uphill moves are accepted (default 0.05).
+    void                    setRefineAcceptRatio(double acceptRatio);
+
+    // How the move managers represent the tour and generate moves; see
+    // TSPMoveMgr.
+    void                    setTourRep(TSPMoveMgr::TourRep rep);
+    void                    setGenerateMode(TSPMoveMgr::GenerateMode mode);
+    void                    setMoveMix(double orOptFraction,
+                                       double threeOptFraction);
+
+    // Finish within this many seconds, or 0 (the default) for no limit;
+    // each level gets a share in proportion to its size. Stop as soon as
+    // possible once the token, which the caller continues to own, is
+    // cancelled; the tour is then expanded to the finest level without
+    // annealing.
+    void                    setTimeBudget(double seconds);
+    void                    setCancelToken(const CancelToken* token);
+
+    // A line per level is written to stdout unless this is turned off.
+    void                    setVerbose(bool verbose);
+
+  private:
+    // A coarse level. City i here stands for cities first[i] and, unless
+    // it's -1, second[i] of the next finer level.
+    struct Level {
+        std::shared_ptr<const TSPInstance> instance;
+        std::vector<int>    first;
+        std::vector<int>    second;
+    };
+
+    void                    coarsen(const TSPInstance& fine,
+                                    const unsigned int seed,
+                                    Level&             coarse) const;
+    double                  anneal(std::shared_ptr<const TSPInstance> instance,
+                                   std::vector<int>&                  order,
+                                   const bool                         refine,
+                                   const unsigned int                 seed,
+                                   const double                       seconds) const;
+    static void             expand(const Level&            coarse,
+                                   const TSPInstance&      fine,
+                                   const std::vector<int>& coarseOrder,
+                                   std::vector<int>&       fineOrder);
+
+    std::shared_ptr<const TSPInstance> _instance;
+    unsigned int            _seed;
+    int                     _coarsestSize;
+    double                  _refineAcceptRatio;
+    TSPMoveMgr::TourRep     _rep;
+    TSPMoveMgr::GenerateMode _mode;
+    double                  _orOptFraction;
+    double                  _threeOptFraction;
+    double                  _timeBudget;
+    const CancelToken*      _cancel;
+    bool                    _verbose;
+};
+
+
+
+#endif
@@ -0,0 +1,470 @@
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+#include "TSPTour.h"
+
+using namespace std;
+
+
+
+void
+ArrayTour::init(const int* order,
+                const int  n)
+{
+    _size = n;
+    _order.assign(order, order + n);
+    _pos.resize(n);
+    for (int i = 0; i < n; ++i) {
+        _pos[order[i]] = i;
+    }
+}
+
+
+
+// Reverse whichever of the paths b..c and d..a is shorter. Either one gives
+// the same cyclic tour.
+void
+ArrayTour::flip(const int a,
+                const int b,
+                const int c,
+                const int d)
+{
+    assert(next(a) == b && next(c) == d);
+
+    int len = _pos[c] - _pos[b];
+    if (len < 0) {
+        len += _size;
+    }
+    if (2 * (len + 1) <= _size) {
+        reverse(_pos[b], _pos[c]);
+    } else {
+        reverse(_pos[d], _pos[a]);
+    }
+}
+
+
+
+// Shift whichever are fewer of the cities from next(b) to c and those from
+// next(c) to a over the segment, the first lot back and the second forward,
+// which leaves a gap after c to put the segment in.
+void
+ArrayTour::moveSegment(const int  a,
+                       const int  b,
+                       const int  c,
+                       const bool reversed)
+{
+    int cities[3];
+    int len = 0;
+    for (int x = next(a); ; x = next(x)) {
+        assert(len < 3 && x != c);
+        cities[len++] = x;
+        if (x == b) {
+            break;
+        }
+    }
+
+    int after = _pos[c] - _pos[b];
+    if (after < 0) {
+        after += _size;
+    }
+    const int before = _size - len - after;
+
+    if (after <= before) {
+        int from = _pos[b];
+        int to   = _pos[a];
+        for (int i = 0; i < after; ++i) {
+            if (++from == _size) {
+                from = 0;
+            }
+            if (++to == _size) {
+                to = 0;
+            }
+            const int x = _order[from];
+            _order[to] = x;
+            _pos[x] = to;
+        }
+    } else {
+        int from = _pos[a];
+        int to   = _pos[b];
+        for (int i = 0; i < before; ++i) {
+            const int x = _order[from];
+            _order[to] = x;
+            _pos[x] = to;
+            if (--from < 0) {
+                from = _size - 1;
+            }
+            if (--to < 0) {
+                to = _size - 1;
+            }
+        }
+    }
+
+    int p = _pos[c];
+    for (int i = 0; i < len; ++i) {
+        if (++p == _size) {
+            p = 0;
+        }
+        const int x = cities[reversed ? len - 1 - i : i];
+        _order[p] = x;
+        _pos[x] = p;
+    }
+}
+
+
+
+void
+ArrayTour::getOrder(std::vector<int>& order) const
+{
+    order.resize(_size);
+    for (int i = 0, c = 0; i < _size; ++i, c = next(c)) {
+        order[i] = c;
+    }
+}
+
+
+
+// Reverse the cities at positions i through j, wrapping around the end of the
+// array if necessary.
+void
+ArrayTour::reverse(int i,
+                   int j)
+{
+    int len = j - i;
+    if (len < 0) {
+        len += _size;
+    }
+    for (int swaps = (len + 1) / 2; swaps > 0; --swaps) {
+        const int ci = _order[i];
+        const int cj = _order[j];
+        _order[i] = cj;
+        _pos[cj] = i;
+        _order[j] = ci;
+        _pos[ci] = j;
+        if (++i == _size) {
+            i = 0;
+        }
+        if (--j < 0) {
+            j = _size - 1;
+        }
+    }
+}
+
+
+
+void
+TwoLevelTour::init(const int* order,
+                   const int  n)
+{
+    _size = n;
+    _groupSize = max(8, int(sqrt(double(n))));
+
+    const int numSegs = (n + _groupSize - 1) / _groupSize;
+    _maxSegments = 2 * numSegs + 8;
+
+    _seg.resize(n);
+    _idx.resize(n);
+    _segs.clear();
+    _segs.reserve(_maxSegments + 2);
+    for (int s = 0; s < numSegs; ++s) {
+        const int lo = s * _groupSize;
+        const int hi = min(n, lo + _groupSize);
+
+        Segment seg;
+        seg.cities.assign(order + lo, order + hi);
+        seg.reversed = false;
+        seg.next = s + 1 == numSegs ? 0 : s + 1;
+        seg.prev = s == 0 ? numSegs - 1 : s - 1;
+        seg.rank = s;
+        _segs.push_back(seg);
+
+        for (int i = lo; i < hi; ++i) {
+            _seg[order[i]] = s;
+            _idx[order[i]] = i - lo;
+        }
+    }
+}
+
+
+
+void
+TwoLevelTour::flip(const int a,
+                   const int b,
+                   const int c,
+                   const int d)
+{
+    assert(next(a) == b && next(c) == d);
+
+    if (a == c || b == c || a == d) {
+        return;     // nothing to reverse
+    }
+
+    // If either path lies within one segment, just reverse it in place.
+    if (_seg[b] == _seg[c] && index(b) <= index(c)) {
+        reverseWithin(b, c);
+        return;
+    }
+    if (_seg[d] == _seg[a] && index(d) <= index(a)) {
+        reverseWithin(d, a);
+        return;
+    }
+
+    // Split so that both paths consist of whole segments, then reverse the
+    // one with fewer segments.
+    split(b);
+    split(d);
+    renumber();
+
+    const int numSegs = int(_segs.size());
+    int bcSegs = _segs[_seg[c]].rank - _segs[_seg[b]].rank;
+    if (bcSegs < 0) {
+        bcSegs += numSegs;
+    }
+    if (2 * (bcSegs + 1) <= numSegs) {
+        reverseSegments(_seg[b], _seg[c]);
+    } else {
+        reverseSegments(_seg[d], _seg[a]);
+    }
+
+    if (numSegs > _maxSegments) {
+        rebuild();
+    } else {
+        renumber();
+    }
+}
+
+
+
+// Take the cities out of their segments and put them back after c, in order
+// or, to reverse them, each right after c.
+void
+TwoLevelTour::moveSegment(const int  a,
+                          const int  b,
+                          const int  c,
+                          const bool reversed)
+{
+    int cities[3];
+    int len = 0;
+    for (int x = next(a); ; x = next(x)) {
+        assert(len < 3 && x != c);
+        cities[len++] = x;
+        if (x == b) {
+            break;
+        }
+    }
+
+    const int numSegs = int(_segs.size());
+    for (int i = 0; i < len; ++i) {
+        removeCity(cities[i]);
+    }
+    for (int i = 0; i < len; ++i) {
+        insertAfter(reversed || i == 0 ? c : cities[i - 1], cities[i]);
+    }
+    bool changed = int(_segs.size()) != numSegs;
+
+    const Segment& s = _segs[_seg[c]];
+    const int      m = int(s.cities.size());
+    if (m > 2 * _groupSize) {
+        split(s.reversed ? s.cities[m - 1 - m / 2] : s.cities[m / 2]);
+        changed = true;
+    }
+
+    if (int(_segs.size()) > _maxSegments) {
+        rebuild();
+    } else if (changed) {
+        renumber();
+    }
+}
+
+
+
+void
+TwoLevelTour::getOrder(std::vector<int>& order) const
+{
+    order.resize(_size);
+    for (int i = 0, c = 0; i < _size; ++i, c = next(c)) {
+        order[i] = c;
+    }
+}
+
+
+
+// Split c's segment so that c is the first city in it. The part of the
+// segment's storage that follows the split point moves to a new segment,
+// which goes after the old one if the segment is forward and before it if
+// the segment is reversed.
+void
+TwoLevelTour::split(const int c)
+{
+    const int k = index(c);
+    if (k == 0) {
+        return;
+    }
+
+    const int si = _seg[c];
+    const int ti = int(_segs.size());
+    _segs.push_back(Segment());
+
+    Segment&  s = _segs[si];
+    Segment&  t = _segs[ti];
+    const int m = int(s.cities.size());
+    const int p = s.reversed ? m - k : k;
+
+    t.cities.assign(s.cities.begin() + p, s.cities.end());
+    s.cities.resize(p);
+    for (int i = 0; i < int(t.cities.size()); ++i) {
+        _seg[t.cities[i]] = ti;
+        _idx[t.cities[i]] = i;
+    }
+    t.reversed = s.reversed;
+    t.rank = s.rank;
+
+    if (s.reversed) {
+        t.next = si;
+        t.prev = s.prev;
+        _segs[s.prev].next = ti;
+        s.prev = ti;
+    } else {
+        t.prev = si;
+        t.next = s.next;
+        _segs[s.next].prev = ti;
+        s.next = ti;
+    }
+}
+
+
+
+// Reverse the order of the whole segments from..to, toggling the reversal bit
+// of each so that the cities within them are reversed too.
+void
+TwoLevelTour::reverseSegments(const int from,
+                              const int to)
+{
+    const int p = _segs[from].prev;
+    const int n = _segs[to].next;
+    assert(p != to);
+
+    for (int s = from; ; ) {
+        Segment& seg = _segs[s];
+        const int following = seg.next;
+        seg.reversed = !seg.reversed;
+        swap(seg.next, seg.prev);
+        if (s == to) {
+            break;
+        }
+        s = following;
+    }
+
+    _segs[to].prev = p;
+    _segs[from].next = n;
+    _segs[p].next = to;
+    _segs[n].prev = from;
+}
+
+
+
+// Reverse the path b..c, which lies within a single segment.
+void
+TwoLevelTour::reverseWithin(const int b,
+                            const int c)
+{
+    std::vector<int>& cities = _segs[_seg[b]].cities;
+    int lo = min(_idx[b], _idx[c]);
+    int hi = max(_idx[b], _idx[c]);
+    for (; lo < hi; ++lo, --hi) {
+        swap(cities[lo], cities[hi]);
+        _idx[cities[lo]] = lo;
+        _idx[cities[hi]] = hi;
+    }
+}
+
+
+
+// Take c out of its segment, and the segment out of the tour if that leaves
+// it empty.
+void
+TwoLevelTour::removeCity(const int c)
+{
+    const int         si     = _seg[c];
+    std::vector<int>& cities = _segs[si].cities;
+    cities.erase(cities.begin() + _idx[c]);
+    for (int i = _idx[c]; i < int(cities.size()); ++i) {
+        _idx[cities[i]] = i;
+    }
+    if (cities.empty()) {
+        removeSegment(si);
+    }
+}
+
+
+
+// Put x into c's segment, right after c in tour order.
+void
+TwoLevelTour::insertAfter(const int c,
+                          const int x)
+{
+    const int si = _seg[c];
+    Segment&  s  = _segs[si];
+    const int i  = s.reversed ? _idx[c] : _idx[c] + 1;
+    s.cities.insert(s.cities.begin() + i, x);
+    _seg[x] = si;
+    for (int j = i; j < int(s.cities.size()); ++j) {
+        _idx[s.cities[j]] = j;
+    }
+}
+
+
+
+// Unlink the empty segment si and move the last segment into its slot, so
+// that the segments stay numbered 0 to _segs.size() - 1. The caller has to
+// renumber them.
+void
+TwoLevelTour::removeSegment(const int si)
+{
+    _segs[_segs[si].prev].next = _segs[si].next;
+    _segs[_segs[si].next].prev = _segs[si].prev;
+
+    const int last = int(_segs.size()) - 1;
+    if (si != last) {
+        swap(_segs[si], _segs[last]);
+        Segment& s = _segs[si];
+        if (s.next == last) {
+            s.next = si;        // it's the only segment left
+            s.prev = si;
+        } else {
+            _segs[s.next].prev = si;
+            _segs[s.prev].next = si;
+        }
+        for (int i = 0; i < int(s.cities.size()); ++i) {
+            _seg[s.cities[i]] = si;
+        }
+    }
+    _segs.pop_back();
+}
+
+
+
+void
+TwoLevelTour::renumber()
+{
+    int s = 0;
+    for (int rank = 0; rank < int(_segs.size()); ++rank) {
+        _segs[s].rank = rank;
+        s = _segs[s].next;
+    }
+    assert(s == 0);
+}
+
+
+
+void
+TwoLevelTour::rebuild()
+{
+    std::vector<int> order;
+    getOrder(order);
+    init(&order[0], _size);
+}
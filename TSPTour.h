@@ -0,0 +1,226 @@
+// Tour representations for TSPMoveMgr
+//
+// Both classes here have the same interface, so the move manager can switch
+// between them without virtual calls on the hot path:
+//
+//   init(order, n)     set the tour to order[0] -> order[1] -> ... -> order[n-1]
+//   next(c), prev(c)   the cities after and before c
+//   between(a, b, c)   true if b is on the forward path from a to c, inclusive
+//   flip(a, b, c, d)   where b == next(a) and d == next(c), replace the edges
+//                      (a,b) and (c,d) with (a,c) and (b,d), i.e. reverse the
+//                      path from b to c. This is the 2-opt move.
+//   moveSegment(a, b, c, reversed)
+//                      move the path of at most three cities from next(a) to
+//                      b to between c and next(c), which must be off it,
+//                      reversing it if reversed. This is the Or-opt move.
+//   getOrder(order)    the cities in tour order, starting with city 0
+//
+// Note that a flip may reverse the complementary path instead, so after it the
+// tour can be traversed in either direction. Only next() and prev() relative
+// to each other are meaningful.
+
+#if !defined(TSPTOUR_H)
+#define TSPTOUR_H
+
+#include <vector>
+
+
+
+//******************************************************************************
+// ArrayTour
+//
+// The tour stored as an array of cities in tour order, plus the inverse
+// mapping. Queries are O(1) and a flip reverses the shorter of the two paths,
+// so it is O(n) in the worst case. Moving a segment shifts the cities on
+// the shorter side of it, between it and where it goes, so it's O(n) in the
+// worst case too, but it makes one pass over them where the same move done
+// as 2-opt flips would make up to three.
+//******************************************************************************
+class ArrayTour {
+  public:
+    void                    init(const int* order, const int n);
+
+    int                     next(const int c) const;
+    int                     prev(const int c) const;
+    bool                    between(const int a, const int b, const int c) const;
+    void                    flip(const int a, const int b, const int c, const int d);
+    void                    moveSegment(const int a, const int b, const int c, const bool reversed);
+    void                    getOrder(std::vector<int>& order) const;
+
+  private:
+    void                    reverse(int i, int j);
+
+    int                     _size;
+    std::vector<int>        _order;   // _order[i] is the i'th city in the tour
+    std::vector<int>        _pos;     // _pos[c] is the index of city c in _order
+};
+
+
+
+//******************************************************************************
+// TwoLevelTour
+//
+// The tour stored as a cyclic list of segments of roughly sqrt(n) cities, each
+// with a reversal bit (Fredman, Johnson, McGeoch and Ostheimer, "Data
+// Structures for Traveling Salesmen", 1995). A flip splits at most two segments
+// so that the path to be reversed consists of whole segments, then reverses
+// the order of those segments and toggles their reversal bits. Queries are
+// O(1) and a flip is O(sqrt(n)) amortized, which is what you want on large
+// instances. The segments are rebuilt from scratch once splitting has doubled
+// their number. Moving a segment of a few cities takes them out of their
+// segments and puts them into the segment holding the city they go after,
+// which is O(sqrt(n)) too; a segment that grows to twice the usual size is
+// split.
+//******************************************************************************
+class TwoLevelTour {
+  public:
+    void                    init(const int* order, const int n);
+
+    int                     next(const int c) const;
+    int                     prev(const int c) const;
+    bool                    between(const int a, const int b, const int c) const;
+    void                    flip(const int a, const int b, const int c, const int d);
+    void                    moveSegment(const int a, const int b, const int c, const bool reversed);
+    void                    getOrder(std::vector<int>& order) const;
+
+  private:
+    struct Segment {
+        std::vector<int>    cities;   // in forward order unless reversed
+        bool                reversed;
+        int                 next;     // segments, in tour order
+        int                 prev;
+        int                 rank;     // position of the segment in the tour
+    };
+
+    int                     first(const Segment& s) const;
+    int                     last(const Segment& s) const;
+    int                     index(const int c) const;
+    long long               key(const int c) const;
+    void                    split(const int c);
+    void                    reverseSegments(const int from, const int to);
+    void                    reverseWithin(const int b, const int c);
+    void                    removeCity(const int c);
+    void                    insertAfter(const int c, const int x);
+    void                    removeSegment(const int si);
+    void                    renumber();
+    void                    rebuild();
+
+    int                     _size;
+    int                     _groupSize;
+    int                     _maxSegments;
+    std::vector<Segment>    _segs;
+    std::vector<int>        _seg;     // _seg[c] is the segment containing city c
+    std::vector<int>        _idx;     // _idx[c] is the index of c in its segment's cities
+};
+
+
+
+inline int
+ArrayTour::next(const int c) const
+{
+    const int i = _pos[c] + 1;
+    return _order[i == _size ? 0 : i];
+}
+
+
+
+inline int
+ArrayTour::prev(const int c) const
+{
+    const int i = _pos[c];
+    return _order[i == 0 ? _size - 1 : i - 1];
+}
+
+
+
+inline bool
+ArrayTour::between(const int a,
+                   const int b,
+                   const int c) const
+{
+    const int pa = _pos[a];
+    const int pb = _pos[b];
+    const int pc = _pos[c];
+    return pa <= pc ? (pa <= pb && pb <= pc) : (pb >= pa || pb <= pc);
+}
+
+
+
+inline int
+TwoLevelTour::first(const Segment& s) const
+{
+    return s.reversed ? s.cities.back() : s.cities.front();
+}
+
+
+
+inline int
+TwoLevelTour::last(const Segment& s) const
+{
+    return s.reversed ? s.cities.front() : s.cities.back();
+}
+
+
+
+// The index of c within its segment, in forward order.
+inline int
+TwoLevelTour::index(const int c) const
+{
+    const Segment& s = _segs[_seg[c]];
+    return s.reversed ? int(s.cities.size()) - 1 - _idx[c] : _idx[c];
+}
+
+
+
+// A key that increases along the tour, starting from the first city of the
+// segment with rank 0.
+inline long long
+TwoLevelTour::key(const int c) const
+{
+    return (long long)(_segs[_seg[c]].rank) * _size + index(c);
+}
+
+
+
+inline int
+TwoLevelTour::next(const int c) const
+{
+    const Segment& s = _segs[_seg[c]];
+    const int      i = _idx[c];
+    if (s.reversed) {
+        return i > 0 ? s.cities[i - 1] : first(_segs[s.next]);
+    } else {
+        return i + 1 < int(s.cities.size()) ? s.cities[i + 1] : first(_segs[s.next]);
+    }
+}
+
+
+
+inline int
+TwoLevelTour::prev(const int c) const
+{
+    const Segment& s = _segs[_seg[c]];
+    const int      i = _idx[c];
+    if (s.reversed) {
+        return i + 1 < int(s.cities.size()) ? s.cities[i + 1] : last(_segs[s.prev]);
+    } else {
+        return i > 0 ? s.cities[i - 1] : last(_segs[s.prev]);
+    }
+}
+
+
+
+inline bool
+TwoLevelTour::between(const int a,
+                      const int b,
+                      const int c) const
+{
+    const long long ka = key(a);
+    const long long kb = key(b);
+    const long long kc = key(c);
+    return ka <= kc ? (ka <= kb && kb <= kc) : (kb >= ka || kb <= kc);
+}
+
+
+
+#endif
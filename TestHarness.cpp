@@ -1,13 +1,14 @@
 #include <algorithm>
 #include <iostream>
 #include <utility>
+#include <vector>
 
 #include <assert.h>
+#include <math.h>
 
 #include "TestHarness.h"
 
-using std::max;
-using std::min;
+using std::copy;
 using std::swap;
 
 
@@ -18,89 +19,265 @@ TestHarnessMoveMgr::TestHarnessMoveMgr(unsigned int problemSize)
 {
     assert(_size > 5);
 
-    srand(5241999);
-
-    // Fill the array with ascending integers, and then shuffle them.
+    // Fill the array with ascending integers, and then shuffle them. The
+    // shuffle uses a fixed seed so the instance doesn't depend on seed().
     for (int i = 0; i < _size; i++) {
         _data[i] = i;
     }
 
+    Random shuffle(5241999);
     for (int i = 1; i < _size; i++) {
-        swap(_data[i], _data[rand() % i]);
+        swap(_data[i], _data[shuffle.below(i)]);
     }
+
+    _pos.resize(_size);
+    for (int i = 0; i < _size; i++) {
+        _pos[_data[i]] = i;
+    }
+
+    std::vector<int> scratch(_data, _data + _size);
+    _score = countInversions(scratch);
+
+    buildGrid();
+}
+
+
+
+TestHarnessMoveMgr::TestHarnessMoveMgr(const TestHarnessMoveMgr& other)
+:   _size(other._size),
+    _data(new int[other._size]),
+    _pos(other._pos),
+    _score(other._score),
+    _blockSize(other._blockSize),
+    _numBlocks(other._numBlocks),
+    _grid(other._grid),
+    _rand(other._rand)
+{
+    copy(other._data, other._data + _size, _data);
+}
+
+
+
+TestHarnessMoveMgr::~TestHarnessMoveMgr()
+{
+    delete[] _data;
 }
 
 
 
 void
-TestHarnessMoveMgr::generateMove(Move* move)
+TestHarnessMoveMgr::seed(unsigned int seed)
 {
-    do {
-        move->_from = rand() % _size;
-        move->_to   = rand() % _size;
-    } while (move->_from == move->_to);
+    _rand.seed(seed);
 }
 
 
 
-int
-TestHarnessMoveMgr::proposeMove(const Move* move)
+TestHarnessMoveMgr*
+TestHarnessMoveMgr::clone() const
 {
-    int cost = 0;
+    return new TestHarnessMoveMgr(*this);
+}
 
-    const int lo = min(move->_from, move->_to);
-    const int hi = max(move->_from, move->_to);
 
-    const int loVal = min(_data[lo], _data[hi]);
-    const int hiVal = max(_data[lo], _data[hi]);
 
-    for (int i = lo + 1; i < hi; i++) {
-        if (_data[i] > loVal && _data[i] < hiVal) {
-            cost += 2;
-        }
-    }
+void
+TestHarnessMoveMgr::copyState(const IMoveMgr<Move, long long>* other)
+{
+    const TestHarnessMoveMgr* src = static_cast<const TestHarnessMoveMgr*>(other);
+    assert(src->_size == _size);
+
+    copy(src->_data, src->_data + _size, _data);
+    _pos = src->_pos;
+    _score = src->_score;
+    _grid = src->_grid;
+}
 
-    cost += 1;  // for the pair [lo,hi]
 
-    return _data[lo] < _data[hi] ? cost : -cost;
+
+void
+TestHarnessMoveMgr::candidateMoves(int                element,
+                                   std::vector<Move>& moves)
+{
+    moves.clear();
+    if (_data[element] != element) {
+        moves.push_back(Move(element, _data[element]));
+        moves.push_back(Move(element, _pos[element]));
+    }
 }
 
 
 
-int
-TestHarnessMoveMgr::makeMove(const Move* move)
+// A swap changes _data at both positions and _pos at both values, and a
+// position's candidates depend on both.
+void
+TestHarnessMoveMgr::touchedElements(const Move*       move,
+                                    std::vector<int>& elements)
 {
-    const int cost = proposeMove(move);
+    elements.clear();
+    elements.push_back(move->_from);
+    elements.push_back(move->_to);
+    elements.push_back(_data[move->_from]);
+    elements.push_back(_data[move->_to]);
+}
+
+
 
-    swap(_data[move->_from], _data[move->_to]);
+// Count the inversions in a by merge sort, in O(n log n). a ends up sorted.
+long long
+TestHarnessMoveMgr::countInversions(std::vector<int>& a)
+{
+    const int        n = int(a.size());
+    std::vector<int> buffer(n);
+    long long        count = 0;
+
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n - width; lo += 2 * width) {
+            const int mid = lo + width;
+            const int hi  = std::min(lo + 2 * width, n);
+            int i = lo;
+            int j = mid;
+            int k = lo;
+            while (i < mid && j < hi) {
+                if (a[j] < a[i]) {
+                    // a[j] is less than everything left in the lower half
+                    count += mid - i;
+                    buffer[k++] = a[j++];
+                } else {
+                    buffer[k++] = a[i++];
+                }
+            }
+            copy(a.begin() + i, a.begin() + mid, buffer.begin() + k);
+            copy(buffer.begin() + lo, buffer.begin() + k + (mid - i), a.begin() + lo);
+        }
+    }
 
-    return cost;
+    return count;
 }
 
 
 
-int
-TestHarnessMoveMgr::getScore()
+// Count the elements in each block of the grid, and then turn the counts into
+// a 2D Fenwick tree by accumulating along each dimension in turn.
+void
+TestHarnessMoveMgr::buildGrid()
 {
-    int cost = 0;
+    _blockSize = std::max(int(sqrt(double(_size))), 1);
+    _numBlocks = (_size + _blockSize - 1) / _blockSize;
+    _grid.assign(size_t(_numBlocks) * _numBlocks, 0);
 
+    const int nb = _numBlocks;
     for (int i = 0; i < _size; i++) {
-        for (int j = i + 1; j < _size; j++) {
-            if (_data[i] > _data[j]) {
-                cost++;
+        ++_grid[size_t(i / _blockSize) * nb + _data[i] / _blockSize];
+    }
+    for (int p = 0; p < nb; p++) {
+        for (int v = 0; v < nb; v++) {
+            const int next = v | (v + 1);
+            if (next < nb) {
+                _grid[size_t(p) * nb + next] += _grid[size_t(p) * nb + v];
+            }
+        }
+    }
+    for (int p = 0; p < nb; p++) {
+        const int next = p | (p + 1);
+        if (next < nb) {
+            for (int v = 0; v < nb; v++) {
+                _grid[size_t(next) * nb + v] += _grid[size_t(p) * nb + v];
             }
         }
     }
+}
+
 
-    return cost;
+
+void
+TestHarnessMoveMgr::gridAdd(const int posBlock,
+                            const int valBlock,
+                            const int n)
+{
+    for (int p = posBlock; p < _numBlocks; p |= p + 1) {
+        for (int v = valBlock; v < _numBlocks; v |= v + 1) {
+            _grid[size_t(p) * _numBlocks + v] += n;
+        }
+    }
 }
 
 
 
-unsigned int
-TestHarnessMoveMgr::getProblemSize()
+// The number of elements in position blocks [0, posBlocks) with values in
+// value blocks [0, valBlocks).
+int
+TestHarnessMoveMgr::gridCount(const int posBlocks,
+                              const int valBlocks) const
 {
-    return _size;
+    int count = 0;
+    for (int p = posBlocks - 1; p >= 0; p = (p & (p + 1)) - 1) {
+        for (int v = valBlocks - 1; v >= 0; v = (v & (v + 1)) - 1) {
+            count += _grid[size_t(p) * _numBlocks + v];
+        }
+    }
+
+    return count;
+}
+
+
+
+// The number of elements strictly between positions lo and hi whose values are
+// strictly between loVal and hiVal.
+int
+TestHarnessMoveMgr::countBetween(const int lo,
+                                 const int hi,
+                                 const int loVal,
+                                 const int hiVal) const
+{
+    // positions [p0, p1), values [v0, v1)
+    const int p0 = lo + 1;
+    const int p1 = hi;
+    const int v0 = loVal + 1;
+    const int v1 = hiVal;
+    if (p0 >= p1 || v0 >= v1) {
+        return 0;
+    }
+
+    int       count = 0;
+    const int size  = _blockSize;
+
+    // If either range is short, just look at the elements in it.
+    if (p1 - p0 <= 2 * size) {
+        for (int i = p0; i < p1; i++) {
+            count += _data[i] >= v0 && _data[i] < v1;
+        }
+        return count;
+    }
+    if (v1 - v0 <= 2 * size) {
+        for (int v = v0; v < v1; v++) {
+            count += _pos[v] >= p0 && _pos[v] < p1;
+        }
+        return count;
+    }
+
+    // Otherwise both ranges include whole blocks. The grid counts the
+    // elements in whole position blocks with values in whole value blocks;
+    // the rest are in the partial blocks at the ends of one range or the other.
+    const int pb0 = (p0 + size - 1) / size;
+    const int pb1 = p1 / size;
+    const int vb0 = (v0 + size - 1) / size;
+    const int vb1 = v1 / size;
+
+    for (int i = p0; i < pb0 * size; i++) {
+        count += _data[i] >= v0 && _data[i] < v1;
+    }
+    for (int i = pb1 * size; i < p1; i++) {
+        count += _data[i] >= v0 && _data[i] < v1;
+    }
+    for (int v = v0; v < vb0 * size; v++) {
+        count += _pos[v] >= pb0 * size && _pos[v] < pb1 * size;
+    }
+    for (int v = vb1 * size; v < v1; v++) {
+        count += _pos[v] >= pb0 * size && _pos[v] < pb1 * size;
+    }
+
+    return count + gridCount(pb1, vb1) - gridCount(pb0, vb1) - gridCount(pb1, vb0) + gridCount(pb0, vb0);
 }
 
 
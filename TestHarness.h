@@ -3,7 +3,13 @@
 #if !defined(TESTHARNESS_H)
 #define TESTHARNESS_H
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "IOptimizer.h"
+#include "Profile.h"
+#include "Random.h"
 
 
 
@@ -18,21 +24,62 @@ class Move {
 
 
 
-class TestHarnessMoveMgr : public IMoveMgr<Move, int> {
+// Sorts an array by swapping pairs of elements; the score is the number of
+// inversions. Final, with the per-move methods inline, so that an optimizer
+// instantiated on this class makes no virtual calls.
+//
+// The inversion count is kept up to date as moves are made, so getScore() is
+// cheap. The delta of a swap depends on how many elements between the two
+// positions have values between the two values, which is a 2D range count.
+// That's answered with a grid of blocks, about sqrt(n) positions by sqrt(n)
+// values, whose counts are kept in a 2D Fenwick tree; only the elements in
+// the partial blocks at the edges of the range are looked at individually.
+// A move then costs O(sqrt(n) + log^2 n) rather than O(n), which makes the
+// harness usable with a million elements.
+class TestHarnessMoveMgr final : public IMoveMgr<Move, long long> {
   public:
     TestHarnessMoveMgr(unsigned int problemSize);
+    TestHarnessMoveMgr(const TestHarnessMoveMgr& other);
+    ~TestHarnessMoveMgr();
 
     virtual void            generateMove(Move* move);
-    virtual int             proposeMove(const Move* move);
-    virtual int             makeMove(const Move* move);
-    virtual int             getScore();
+    virtual long long       proposeMove(const Move* move);
+    virtual long long       makeMove(const Move* move);
+    virtual long long       getScore();
     virtual unsigned int    getProblemSize();
+    virtual void            seed(unsigned int seed);
+    virtual TestHarnessMoveMgr* clone() const;
+    virtual void            copyState(const IMoveMgr<Move, long long>* other);
+
+    // The elements are the positions. The candidates for a position swap
+    // its value into the position it belongs in, and swap in the value that
+    // belongs here, which is enough for a local search to finish sorting.
+    virtual void            candidateMoves(int                element,
+                                           std::vector<Move>& moves);
+    virtual void            touchedElements(const Move*       move,
+                                            std::vector<int>& elements);
 
     virtual void            debug();
 
   private:
-    int     _size;
-    int*    _data;
+    TestHarnessMoveMgr&     operator=(const TestHarnessMoveMgr&);   // not implemented
+
+  private:
+    static long long        countInversions(std::vector<int>& a);
+    void                    buildGrid();
+    void                    gridAdd(const int posBlock, const int valBlock, const int n);
+    int                     gridCount(const int posBlocks, const int valBlocks) const;
+    int                     countBetween(const int lo, const int hi, const int loVal, const int hiVal) const;
+
+  private:
+    int                 _size;
+    int*                _data;
+    std::vector<int>    _pos;           // _data[_pos[v]] == v
+    long long           _score;
+    int                 _blockSize;
+    int                 _numBlocks;
+    std::vector<int>    _grid;          // Fenwick tree over [position block][value block] counts
+    Random              _rand;
 };
 
 
@@ -47,5 +94,80 @@ Move::Move(int from,
 
 
 
-#endif
+inline void
+TestHarnessMoveMgr::generateMove(Move* move)
+{
+    do {
+        PROFILE_RETRY();
+        move->_from = _rand.below(_size);
+        move->_to   = _rand.below(_size);
+    } while (move->_from == move->_to);
+}
+
+
+
+// Swapping the elements at lo and hi fixes or creates the inversion between
+// them, and two more for each element in between whose value is in between.
+inline long long
+TestHarnessMoveMgr::proposeMove(const Move* move)
+{
+    const int lo = std::min(move->_from, move->_to);
+    const int hi = std::max(move->_from, move->_to);
+
+    const int loVal = std::min(_data[lo], _data[hi]);
+    const int hiVal = std::max(_data[lo], _data[hi]);
+
+    const long long cost = 2LL * countBetween(lo, hi, loVal, hiVal) + 1;
+
+    return _data[lo] < _data[hi] ? cost : -cost;
+}
+
 
+
+inline long long
+TestHarnessMoveMgr::makeMove(const Move* move)
+{
+    const long long cost = proposeMove(move);
+    _score += cost;
+
+    const int from    = move->_from;
+    const int to      = move->_to;
+    const int fromVal = _data[from];
+    const int toVal   = _data[to];
+    const int fromPosBlock = from / _blockSize;
+    const int toPosBlock   = to / _blockSize;
+    const int fromValBlock = fromVal / _blockSize;
+    const int toValBlock   = toVal / _blockSize;
+    if (fromPosBlock != toPosBlock && fromValBlock != toValBlock) {
+        gridAdd(fromPosBlock, fromValBlock, -1);
+        gridAdd(toPosBlock, fromValBlock, 1);
+        gridAdd(toPosBlock, toValBlock, -1);
+        gridAdd(fromPosBlock, toValBlock, 1);
+    }
+
+    std::swap(_data[from], _data[to]);
+    _pos[fromVal] = to;
+    _pos[toVal] = from;
+
+    return cost;
+}
+
+
+
+inline long long
+TestHarnessMoveMgr::getScore()
+{
+    return _score;
+}
+
+
+
+inline unsigned int
+TestHarnessMoveMgr::getProblemSize()
+{
+    return _size;
+}
+
+
+
+#endif
@@ -0,0 +1,616 @@
+// A reproducible benchmark of the optimizers. It generates uniform, clustered
+// and grid TSP instances and a sorting harness instance, reads any TSPLIB
+// files named on the command line, and runs the Annealer and LocalOpt on each
+// with fixed seeds. For each run it reports the final cost, the time, the
+// moves proposed per second, the time until the best cost so far came within
+// a given percentage of the best final cost of any run on that instance, and
+// how much the run added to the process's resident set at its peak: the peak
+// during the run less the resident set size before it. The peak can only be
+// reset between runs on Linux; elsewhere it's the process's high-water mark,
+// so a run's figure is only its own when it's the largest so far.
+//
+// Built by the "benchmark" CMake target, and run as
+//   benchmark [option ...] [file.tsp ...]
+// where the options are
+//   cities=N       size of the generated TSP instances (default 1000)
+//   sort=N         size of the sorting harness instance (default 1000), 0 for none
+//   seeds=N        runs of each optimizer on each instance (default 3)
+//   within=X       the percentage for the time-to-target column (default 1)
+//   neighbor       generate TSP moves from nearest-neighbor lists
+//   twolevel       use the two-level list tour
+//   batch          run the Annealer in batched mode
+//   hilbert        renumber the cities along a Hilbert curve, which also
+//                  makes the starting tour follow the curve
+//   nosynthetic    skip the generated TSP instances
+// Every number but the times and rates is the same from run to run.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Annealer.h"
+#include "LocalOpt.h"
+#include "Random.h"
+#include "TestHarness.h"
+#include "TSPInstance.h"
+#include "TSPMoveMgr.h"
+
+using namespace std;
+
+
+
+//******************************************************************************
+// TracingMoveMgr
+//
+// Passes every call through to a concrete move manager, counting the moves
+// proposed and noting the time of each new best score. It's a template on the
+// move manager rather than an IMoveMgr, so the optimizers' calls through it
+// stay non-virtual and the rates measured are those of a normal build.
+//******************************************************************************
+template<class MoveMgrType,
+         class MoveType,
+         class CostType>
+class TracingMoveMgr {
+  public:
+    struct Point {
+        double              seconds;
+        CostType            cost;
+    };
+
+    TracingMoveMgr(MoveMgrType& moveMgr);
+
+    void                    generateMove(MoveType* move);
+    CostType                proposeMove(const MoveType* move);
+    void                    proposeMoves(const MoveType* moves, CostType* deltas, size_t n);
+    CostType                makeMove(const MoveType* move);
+    CostType                getScore();
+    unsigned int            getProblemSize();
+    void                    seed(unsigned int seed);
+    TracingMoveMgr*         clone() const;
+    void                    copyState(const TracingMoveMgr* other);
+    bool                    saveState(std::ostream& out) const;
+    bool                    restoreState(std::istream& in,
+                                         std::string&  error);
+    void                    candidateMoves(int element, vector<MoveType>& moves);
+    void                    touchedElements(const MoveType* move, vector<int>& elements);
+
+    double                  seconds() const;
+
+    MoveMgrType&            _moveMgr;
+    chrono::steady_clock::time_point _start;
+    unsigned long long      _proposed;
+    CostType                _best;
+    vector<Point>           _trace;                 // each new best, in order
+    unique_ptr<MoveMgrType> _owned;                 // for clones, the move manager they wrap
+};
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::TracingMoveMgr(MoveMgrType& moveMgr)
+:   _moveMgr(moveMgr),
+    _start(chrono::steady_clock::now()),
+    _proposed(0),
+    _best(moveMgr.getScore())
+{
+    const Point first = { 0.0, _best };
+    _trace.push_back(first);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::generateMove(MoveType* move)
+{
+    _moveMgr.generateMove(move);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline CostType
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::proposeMove(const MoveType* move)
+{
+    ++_proposed;
+    return _moveMgr.proposeMove(move);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::proposeMoves(const MoveType* moves,
+                                                              CostType*       deltas,
+                                                              size_t          n)
+{
+    _proposed += n;
+    _moveMgr.proposeMoves(moves, deltas, n);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline CostType
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::makeMove(const MoveType* move)
+{
+    const CostType delta = _moveMgr.makeMove(move);
+    const CostType score = _moveMgr.getScore();
+    if (score < _best) {
+        _best = score;
+        const Point point = { seconds(), score };
+        _trace.push_back(point);
+    }
+    return delta;
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline CostType
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::getScore()
+{
+    return _moveMgr.getScore();
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline unsigned int
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::getProblemSize()
+{
+    return _moveMgr.getProblemSize();
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::seed(unsigned int seed)
+{
+    _moveMgr.seed(seed);
+}
+
+
+
+// Clones, which the optimizers use to hold copies of the state, wrap a clone
+// of the move manager and aren't traced themselves.
+template<class MoveMgrType, class MoveType, class CostType>
+TracingMoveMgr<MoveMgrType, MoveType, CostType>*
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::clone() const
+{
+    MoveMgrType*    copy   = static_cast<MoveMgrType*>(_moveMgr.clone());
+    TracingMoveMgr* tracer = new TracingMoveMgr(*copy);
+    tracer->_owned.reset(copy);
+    return tracer;
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::copyState(const TracingMoveMgr* other)
+{
+    _moveMgr.copyState(&other->_moveMgr);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline bool
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::saveState(std::ostream& out) const
+{
+    return _moveMgr.saveState(out);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline bool
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::restoreState(std::istream& in,
+                                                              std::string&  error)
+{
+    return _moveMgr.restoreState(in, error);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::candidateMoves(int               element,
+                                                                vector<MoveType>& moves)
+{
+    _moveMgr.candidateMoves(element, moves);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline void
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::touchedElements(const MoveType* move,
+                                                                 vector<int>&    elements)
+{
+    _moveMgr.touchedElements(move, elements);
+}
+
+
+
+template<class MoveMgrType, class MoveType, class CostType>
+inline double
+TracingMoveMgr<MoveMgrType, MoveType, CostType>::seconds() const
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+}
+
+
+
+// What's reported for one run.
+struct Run {
+    string                  instance;
+    string                  optimizer;
+    unsigned int            seed;
+    double                  cost;
+    double                  seconds;
+    double                  movesPerSec;
+    vector<pair<double, double> > trace;            // (seconds, best cost)
+    double                  runMB;          // peak resident set size over the baseline
+};
+
+
+
+struct Options {
+    int                     cities;
+    int                     sortSize;
+    int                     seeds;
+    double                  within;
+    bool                    synthetic;
+    bool                    hilbert;
+    unsigned int            batchSize;
+    TSPMoveMgr::TourRep      rep;
+    TSPMoveMgr::GenerateMode mode;
+};
+
+
+
+// Start measuring the peak resident set size afresh, where that's possible.
+static void
+resetPeakRss()
+{
+#if defined(__linux__)
+    ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+
+
+// The resident set size of the process now, and its peak since the last
+// resetPeakRss(), in megabytes. Where the current size can't be had, it's 0.
+static void
+rssMB(double& current,
+      double& peak)
+{
+    current = 0.0;
+    peak = 0.0;
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        current = counters.WorkingSetSize / (1024.0 * 1024.0);
+        peak = counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+#elif defined(__linux__)
+    ifstream status("/proc/self/status");
+    string   key;
+    double   kb;
+    while (status >> key) {
+        if (key == "VmRSS:" && status >> kb) {
+            current = kb / 1024.0;
+        } else if (key == "VmHWM:" && status >> kb) {
+            peak = kb / 1024.0;
+        }
+    }
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        peak = usage.ru_maxrss / (1024.0 * 1024.0);     // bytes
+#else
+        peak = usage.ru_maxrss / 1024.0;                // kilobytes
+#endif
+    }
+#endif
+}
+
+
+
+// Cities uniformly distributed over a square.
+static shared_ptr<TSPInstance>
+uniformInstance(const int    cities,
+                unsigned int seed)
+{
+    Random         rand(seed);
+    vector<double> x(cities);
+    vector<double> y(cities);
+    for (int i = 0; i < cities; ++i) {
+        x[i] = rand.uniform() * 1000000.0;
+        y[i] = rand.uniform() * 1000000.0;
+    }
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init("uniform", x, y);
+    return instance;
+}
+
+
+
+// Cities normally distributed around cities / 10 uniformly placed centers,
+// as in the DIMACS TSP challenge's clustered instances.
+static shared_ptr<TSPInstance>
+clusteredInstance(const int    cities,
+                  unsigned int seed)
+{
+    Random         rand(seed);
+    const int      numCenters = max(1, cities / 10);
+    vector<double> cx(numCenters);
+    vector<double> cy(numCenters);
+    for (int c = 0; c < numCenters; ++c) {
+        cx[c] = rand.uniform() * 1000000.0;
+        cy[c] = rand.uniform() * 1000000.0;
+    }
+
+    const double   sigma = 1000000.0 / sqrt(double(cities));
+    vector<double> x(cities);
+    vector<double> y(cities);
+    for (int i = 0; i < cities; ++i) {
+        // Box-Muller
+        const int    c     = rand.below(numCenters);
+        const double r     = sigma * sqrt(-2.0 * log(1.0 - rand.uniform()));
+        const double theta = 2.0 * 3.14159265358979323846 * rand.uniform();
+        x[i] = cx[c] + r * cos(theta);
+        y[i] = cy[c] + r * sin(theta);
+    }
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init("clustered", x, y);
+    return instance;
+}
+
+
+
+// Cities on a square lattice, filled row by row. Every lattice tour of a
+// full grid with an even side is optimal, and there are many of them, which
+// makes for a flat landscape unlike the random instances'.
+static shared_ptr<TSPInstance>
+gridInstance(const int cities)
+{
+    const int      side = int(ceil(sqrt(double(cities))));
+    vector<double> x(cities);
+    vector<double> y(cities);
+    for (int i = 0; i < cities; ++i) {
+        x[i] = (i % side) * 1000.0;
+        y[i] = (i / side) * 1000.0;
+    }
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init("grid", x, y);
+    return instance;
+}
+
+
+
+// The instance, with its cities renumbered if the options say so.
+static shared_ptr<TSPInstance>
+renumbered(shared_ptr<TSPInstance> instance,
+           const Options&          options)
+{
+    if (options.hilbert) {
+        instance->renumberHilbert();
+    }
+    return instance;
+}
+
+
+
+// Run one optimizer on a copy of start, and fill in what's measured.
+template<class MoveType,
+         class CostType,
+         class MoveMgrType,
+         class OptimizerType>
+static void
+runOne(const MoveMgrType& start,
+       OptimizerType&     optimizer,
+       const unsigned int seed,
+       Run&               run)
+{
+    double baseline;
+    double peak;
+    resetPeakRss();
+    rssMB(baseline, peak);
+
+    MoveMgrType moveMgr(start);
+    moveMgr.seed(seed);
+
+    TracingMoveMgr<MoveMgrType, MoveType, CostType> tracer(moveMgr);
+    optimizer.optimize(&tracer);
+
+    run.seed        = seed;
+    run.cost        = double(moveMgr.getScore());
+    run.seconds     = tracer.seconds();
+    run.movesPerSec = run.seconds > 0.0 ? tracer._proposed / run.seconds : 0.0;
+    for (size_t i = 0; i < tracer._trace.size(); ++i) {
+        run.trace.push_back(make_pair(tracer._trace[i].seconds, double(tracer._trace[i].cost)));
+    }
+    double after;
+    rssMB(after, peak);
+    run.runMB       = max(peak - baseline, 0.0);
+}
+
+
+
+// Run the Annealer and LocalOpt with each seed on a problem, adding the runs
+// to runs.
+template<class MoveType,
+         class CostType,
+         class MoveMgrType>
+static void
+runAll(const string&      name,
+       const MoveMgrType& start,
+       const Options&     options,
+       vector<Run>&       runs)
+{
+    typedef TracingMoveMgr<MoveMgrType, MoveType, CostType> Tracer;
+
+    for (int s = 1; s <= options.seeds; ++s) {
+        Run run;
+        run.instance  = name;
+        run.optimizer = "anneal";
+        Annealer<MoveType, CostType, Tracer> sa(s);
+        sa.setVerbose(false);
+        sa.setBatchSize(options.batchSize);
+        runOne<MoveType, CostType>(start, sa, s, run);
+        runs.push_back(run);
+        cerr << name << " anneal " << s << " done\n";
+    }
+
+    for (int s = 1; s <= options.seeds; ++s) {
+        Run run;
+        run.instance  = name;
+        run.optimizer = "localopt";
+        LocalOpt<MoveType, CostType, Tracer> lo;
+        lo.setVerbose(false);
+        runOne<MoveType, CostType>(start, lo, s, run);
+        runs.push_back(run);
+        cerr << name << " localopt " << s << " done\n";
+    }
+}
+
+
+
+static void
+runTSP(shared_ptr<const TSPInstance> instance,
+       const Options&                options,
+       vector<Run>&                  runs)
+{
+    TSPMoveMgr start(instance, options.rep);
+    start.setGenerateMode(options.mode);
+    runAll<TSPMove, double>(instance->getName(), start, options, runs);
+}
+
+
+
+// Print the runs, with the time each took to come within options.within
+// percent of the best final cost of any run on the same instance.
+static void
+report(const vector<Run>& runs,
+       const Options&     options)
+{
+    printf("%-16s %-9s %4s %16s %10s %12s %10s %9s\n",
+           "instance", "optimizer", "seed", "cost", "seconds", "moves/s", "to target", "run MB");
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+        const Run& run = runs[i];
+
+        double best = run.cost;
+        for (size_t j = 0; j < runs.size(); ++j) {
+            if (runs[j].instance == run.instance) {
+                best = min(best, runs[j].cost);
+            }
+        }
+        const double target = best + fabs(best) * options.within / 100.0;
+
+        char toTarget[32] = "-";
+        for (size_t k = 0; k < run.trace.size(); ++k) {
+            if (run.trace[k].second <= target) {
+                snprintf(toTarget, sizeof(toTarget), "%.3f", run.trace[k].first);
+                break;
+            }
+        }
+
+        printf("%-16s %-9s %4u %16.0f %10.3f %12.4g %10s %9.1f\n",
+               run.instance.c_str(), run.optimizer.c_str(), run.seed, run.cost, run.seconds,
+               run.movesPerSec, toTarget, run.runMB);
+    }
+}
+
+
+
+int
+main(int   argc,
+     char* argv[])
+{
+    Options options;
+    options.cities    = 1000;
+    options.sortSize  = 1000;
+    options.seeds     = 3;
+    options.within    = 1.0;
+    options.synthetic = true;
+    options.hilbert   = false;
+    options.batchSize = 1;
+    options.rep       = TSPMoveMgr::ArrayRep;
+    options.mode      = TSPMoveMgr::UniformGen;
+
+    vector<string> files;
+    for (int i = 1; i < argc; ++i) {
+        const string arg(argv[i]);
+        if (arg.compare(0, 7, "cities=") == 0) {
+            options.cities = atoi(arg.c_str() + 7);
+        } else if (arg.compare(0, 5, "sort=") == 0) {
+            options.sortSize = atoi(arg.c_str() + 5);
+        } else if (arg.compare(0, 6, "seeds=") == 0) {
+            options.seeds = atoi(arg.c_str() + 6);
+        } else if (arg.compare(0, 7, "within=") == 0) {
+            options.within = atof(arg.c_str() + 7);
+        } else if (arg == "neighbor") {
+            options.mode = TSPMoveMgr::NeighborGen;
+        } else if (arg == "twolevel") {
+            options.rep = TSPMoveMgr::TwoLevelRep;
+        } else if (arg == "batch") {
+            options.batchSize = 64;
+        } else if (arg == "hilbert") {
+            options.hilbert = true;
+        } else if (arg == "nosynthetic") {
+            options.synthetic = false;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    vector<Run> runs;
+
+    if (options.synthetic && options.cities > 3) {
+        runTSP(renumbered(uniformInstance(options.cities, 1), options), options, runs);
+        runTSP(renumbered(clusteredInstance(options.cities, 2), options), options, runs);
+        runTSP(renumbered(gridInstance(options.cities), options), options, runs);
+    }
+
+    for (size_t f = 0; f < files.size(); ++f) {
+        shared_ptr<TSPInstance> instance(new TSPInstance);
+        string error;
+        if (!instance->load(files[f], error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        runTSP(renumbered(instance, options), options, runs);
+    }
+
+    if (options.sortSize > 1) {
+        TestHarnessMoveMgr start(options.sortSize);
+        runAll<Move, long long>("sort", start, options, runs);
+    }
+
+    report(runs, options);
+
+    return 0;
+}
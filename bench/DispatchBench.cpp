@@ -0,0 +1,101 @@
+// Compare an Annealer that calls its move manager through the IMoveMgr vtable
+// with one instantiated on the concrete move manager class, on a random TSP
+// instance and on the sorting test harness. Both follow exactly the same
+// Markov chain, so the difference in time is the cost of the virtual calls.
+//
+// Built by the "dispatchbench" CMake target, and run as
+//   dispatchbench [cities [sort size [repeats]]]
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "Annealer.h"
+#include "Random.h"
+#include "TestHarness.h"
+#include "TSPInstance.h"
+#include "TSPMoveMgr.h"
+
+using namespace std;
+
+
+
+// Anneal a fresh copy of the problem, and return the time taken.
+template<class MoveType,
+         class CostType,
+         class MoveMgrType,
+         class ConcreteType>
+static double
+timeAnneal(const ConcreteType& start,
+           CostType&           score)
+{
+    ConcreteType                              moveMgr(start);
+    Annealer<MoveType, CostType, MoveMgrType> sa;
+    sa.setVerbose(false);
+
+    const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    sa.optimize(&moveMgr);
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    score = moveMgr.getScore();
+    return chrono::duration<double>(end - begin).count();
+}
+
+
+
+// Time both builds, taking the best of several runs of each.
+template<class MoveType,
+         class CostType,
+         class ConcreteType>
+static void
+compare(const char*         name,
+        const ConcreteType& start,
+        const int           repeats)
+{
+    double   virtualTime = 1e30;
+    double   staticTime  = 1e30;
+    CostType virtualScore = CostType();
+    CostType staticScore  = CostType();
+    for (int i = 0; i < repeats; ++i) {
+        virtualTime = min(virtualTime,
+                          timeAnneal<MoveType, CostType, IMoveMgr<MoveType, CostType> >(start, virtualScore));
+        staticTime = min(staticTime, timeAnneal<MoveType, CostType, ConcreteType>(start, staticScore));
+    }
+
+    cout << name << ": virtual " << virtualTime << "s (c=" << virtualScore << "), static "
+         << staticTime << "s (c=" << staticScore << "), speedup " << virtualTime / staticTime << "\n";
+}
+
+
+
+int
+main(int   argc,
+     char* argv[])
+{
+    const int cities   = argc > 1 ? atoi(argv[1]) : 2000;
+    const int sortSize = argc > 2 ? atoi(argv[2]) : 300;
+    const int repeats  = argc > 3 ? atoi(argv[3]) : 3;
+
+    Random         rand(1);
+    vector<double> x(cities);
+    vector<double> y(cities);
+    for (int i = 0; i < cities; ++i) {
+        x[i] = rand.uniform() * 1000000.0;
+        y[i] = rand.uniform() * 1000000.0;
+    }
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init("random", x, y);
+
+    TSPMoveMgr tsp(instance);
+    tsp.setGenerateMode(TSPMoveMgr::NeighborGen);
+    compare<TSPMove, double>("tsp", tsp, repeats);
+
+    TestHarnessMoveMgr sort(sortSize);
+    compare<Move, long long>("sort", sort, repeats);
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Compare the Annealer's two ways of finding the starting temperature: the
+// binary search, and the single sample of uphill moves. For each, report the
+// starting temperature, the time until the first equilibrium is done, and the
+// total time and final cost of the whole anneal.
+//
+// Built by the "starttempbench" CMake target, and run as
+//   starttempbench [cities [accept ratio]]
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "Annealer.h"
+#include "CoolingSchedule.h"
+#include "Random.h"
+#include "TSPInstance.h"
+#include "TSPMoveMgr.h"
+
+using namespace std;
+
+
+
+//******************************************************************************
+// FirstEquilibriumTimer
+//
+// The default geometric schedule, noting when it's first consulted, which is
+// right after the first equilibrium, and at what temperature.
+//******************************************************************************
+class FirstEquilibriumTimer : public ICoolingSchedule {
+  public:
+    FirstEquilibriumTimer();
+
+    virtual double          nextTemp(const double            temp,
+                                     const EquilibriumStats& stats);
+
+    bool                                    _done;
+    double                                  _startTemp;
+    chrono::steady_clock::time_point        _when;
+    GeometricSchedule                       _geometric;
+};
+
+
+
+FirstEquilibriumTimer::FirstEquilibriumTimer()
+:   _done(false),
+    _startTemp(0.0)
+{
+}
+
+
+
+double
+FirstEquilibriumTimer::nextTemp(const double            temp,
+                                const EquilibriumStats& stats)
+{
+    if (!_done) {
+        _done = true;
+        _startTemp = temp;
+        _when = chrono::steady_clock::now();
+    }
+
+    return _geometric.nextTemp(temp, stats);
+}
+
+
+
+typedef Annealer<TSPMove, double, TSPMoveMgr> TSPAnnealer;
+
+
+
+static void
+run(const char*                   name,
+    shared_ptr<const TSPInstance> instance,
+    TSPAnnealer::StartTempMethod  method,
+    double                        acceptRatio)
+{
+    TSPMoveMgr            moveMgr(instance);
+    TSPAnnealer           sa;
+    FirstEquilibriumTimer timer;
+    sa.setVerbose(false);
+    sa.setSchedule(&timer);
+    sa.setStartTempMethod(method, acceptRatio);
+
+    const chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    sa.optimize(&moveMgr);
+    const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    cout << name << ": t0=" << timer._startTemp
+         << " first equilibrium " << chrono::duration<double>(timer._when - begin).count() << "s"
+         << ", total " << chrono::duration<double>(end - begin).count() << "s"
+         << ", c=" << moveMgr.getScore() << "\n";
+}
+
+
+
+int
+main(int   argc,
+     char* argv[])
+{
+    const int    cities      = argc > 1 ? atoi(argv[1]) : 2000;
+    const double acceptRatio = argc > 2 ? atof(argv[2]) : 0.8;
+
+    Random         rand(1);
+    vector<double> x(cities);
+    vector<double> y(cities);
+    for (int i = 0; i < cities; ++i) {
+        x[i] = rand.uniform() * 1000000.0;
+        y[i] = rand.uniform() * 1000000.0;
+    }
+    shared_ptr<TSPInstance> instance(new TSPInstance);
+    instance->init("random", x, y);
+
+    run("binary search", instance, TSPAnnealer::BinarySearchTemp, acceptRatio);
+    run("sampled", instance, TSPAnnealer::SampledTemp, acceptRatio);
+
+    return 0;
+}
@@ -1,9 +1,137 @@
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "Annealer.h"
+#include "CancelToken.h"
+#include "CoolingSchedule.h"
 #include "LocalOpt.h"
+#include "MultiStartAnnealer.h"
+#include "Observer.h"
+#include "ParallelTempering.h"
 #include "TestHarness.h"
+#include "TSPConstruction.h"
+#include "TSPDecomposer.h"
+#include "TSPInstance.h"
 #include "TSPMoveMgr.h"
+#include "TSPMultilevel.h"
+
+
+
+static CancelToken interrupted;
+
+
+
+//******************************************************************************
+// Options
+//
+// The options given after the instance name; see main.
+//******************************************************************************
+struct Options {
+    TSPMoveMgr::TourRep      rep       = TSPMoveMgr::ArrayRep;
+    TSPMoveMgr::GenerateMode mode      = TSPMoveMgr::UniformGen;
+    double                   orOpt     = 0.0;
+    double                   threeOpt  = 0.0;
+    unsigned int             batchSize = 1;
+    ICoolingSchedule*        schedule  = 0;
+    bool                     sampled   = false;
+    std::string              recordFile;
+    RecordWriter::Format     recordFormat = RecordWriter::Csv;
+    std::string              cacheFile;
+    std::string              tourFile;
+    std::string              startMethod;
+    double                   warmRatio = 0.0;
+    double                   startTemp = 0.0;
+    std::string              checkpointFile;
+    std::string              resumeFile;
+    double                   timeBudget = 0.0;
+    bool                     polish    = false;
+    unsigned int             speculationThreads = 1;
+    bool                     multilevel = false;
+    bool                     hilbert   = false;
+    int                      decomposeRounds = 0;
+    bool                     integerCosts = false;
+};
+
+
+
+static void
+onInterrupt(int)
+{
+    interrupted.cancel();
+}
+
+
+
+// Anneal from the tour, or from the cities in order if it's empty, unless
+// multilevel annealing or decomposition has already done that, then polish
+// and report the result. Costs are of type CostType: double, or long long for
+// distances rounded to integers.
+template<class CostType>
+static int
+annealTour(std::shared_ptr<const TSPInstance> instance,
+           const std::vector<int>&            tour,
+           const Options&                     options,
+           IObserver*                         observer,
+           const clock_t                      start)
+{
+    std::string error;
+
+    TSPMoveMgrT<CostType> tspmm = tour.empty() ? TSPMoveMgrT<CostType>(instance, options.rep) :
+                                                  TSPMoveMgrT<CostType>(instance, tour, options.rep);
+    tspmm.setGenerateMode(options.mode);
+    tspmm.setMoveMix(options.orOpt, options.threeOpt);
+    // Instantiated on TSPMoveMgrT rather than the default IMoveMgr, so that
+    // the calls on the move manager aren't virtual.
+    Annealer<TSPMove, CostType, TSPMoveMgrT<CostType> > sa;
+    //ParallelTempering<TSPMove, CostType, TSPMoveMgrT<CostType> > sa;
+    //MultiStartAnnealer<TSPMove, CostType, TSPMoveMgrT<CostType> > sa(8);
+    sa.setBatchSize(options.batchSize);     // Annealer only
+    sa.setSchedule(options.schedule);                       // Annealer only
+    if (observer != 0) {
+        sa.setObserver(observer);
+    }
+    if (options.warmRatio > 0.0) {
+        sa.setStartTempMethod(Annealer<TSPMove, CostType, TSPMoveMgrT<CostType> >::SampledTemp, options.warmRatio);
+        sa.setRequiredImprovement(0.0);                     // Annealer only
+    } else if (options.sampled) {
+        sa.setStartTempMethod(Annealer<TSPMove, CostType, TSPMoveMgrT<CostType> >::SampledTemp);
+    }
+    sa.setStartTemp(options.startTemp);                     // Annealer only
+    if (!options.checkpointFile.empty()) {
+        sa.setCheckpoint(options.checkpointFile, 10);       // Annealer only
+    }
+    if (!options.resumeFile.empty() && !sa.restore(options.resumeFile, &tspmm, error)) {    // Annealer only
+        std::cerr << error << "\n";
+        return 1;
+    }
+    sa.setTimeBudget(options.timeBudget);                   // Annealer only
+    sa.setCancelToken(&interrupted);                        // Annealer only
+    sa.setKeepBest(true);                                   // Annealer only
+    sa.setSpeculation(options.speculationThreads);          // Annealer only
+    if (!options.multilevel && options.decomposeRounds == 0) {
+        signal(SIGINT, onInterrupt);
+        sa.optimize(&tspmm);
+        signal(SIGINT, SIG_DFL);
+    }
+
+    if (options.polish) {
+        LocalOpt<TSPMove, CostType, TSPMoveMgrT<CostType> > lo;
+        lo.optimize(&tspmm);
+    }
+
+    tspmm.debug();
+
+    std::cout << "Elapsed time = " << (float(clock() - start) / CLOCKS_PER_SEC) << "\n";
+
+    return 0;
+}
 
 
 
@@ -14,16 +142,195 @@ main(int   argc,
     clock_t start = clock();
 
     //TestHarnessMoveMgr thmm(1000);
-    //Annealer<Move, int>	lo;
+    //Annealer<Move, long long>	lo;
     //lo.optimize(&thmm);
 
-    TSPMoveMgr tspmm(argv[1]);
-    Annealer<TSPMove, double> sa;
-    sa.optimize(&tspmm);
-    
-    tspmm.debug();
+    // Options after the instance name: "hilbert" to renumber the cities along a
+    // Hilbert curve for locality of reference (the tour printed at the end
+    // still uses the file's numbering), "twolevel" to use the two-level list
+    // tour, "neighbor" to generate moves from nearest-neighbor lists, "oropt"
+    // and "or3opt" to mix in Or-opt and or-3opt moves, "batch" to evaluate
+    // moves in vectorized batches, "huang" or "lam" for an adaptive cooling
+    // schedule, "sampled" to estimate the starting temperature from a sample of
+    // uphill moves, "csv=FILE" or "jsonl=FILE" to write the progress records to
+    // a file instead of the console, "cache=FILE" to load the instance from a
+    // binary cache FILE made from the instance file as it is now, and otherwise
+    // to parse the file and write the cache, "tour=FILE" to start from a TSPLIB
+    // tour, "start=nn", "start=greedy", "start=sfc" or "start=savings" to start
+    // from a tour built by nearest neighbor, greedy edge matching, a space-
+    // filling curve or Clarke-Wright savings, "warm" or "warm=R" to treat the
+    // starting tour as good and anneal it from the sampled temperature at which
+    // a fraction R (default 0.1) of uphill moves are accepted, "temp=T" to
+    // start at temperature T, "checkpoint=FILE" to checkpoint every 10
+    // equilibria, "resume=FILE" to carry on from a checkpoint, "time=SECONDS"
+    // to finish within that long, "speculate" or "speculate=N" to propose moves
+    // on all hardware threads or on N threads once most are being rejected,
+    // "multilevel" to anneal coarsened instances and refine their tours with
+    // TSPMultilevel instead, "decompose" or "decompose=ROUNDS" to anneal
+    // regions of the plane in parallel with TSPDecomposer instead (or after
+    // "multilevel"), "polish" to finish with a 2-opt local search, and "nint"
+    // to round distances to the nearest integer as TSPLIB does, and keep costs
+    // in integers. Interrupting the program ends the anneal early with the best
+    // tour found so far.
+    Options       options;
+    HuangSchedule huang;
+    LamSchedule   lam;
+    for (int i = 2; i < argc; ++i) {
+        const std::string option(argv[i]);
+        if (option == "hilbert") {
+            options.hilbert = true;
+        } else if (option == "twolevel") {
+            options.rep = TSPMoveMgr::TwoLevelRep;
+        } else if (option == "neighbor") {
+            options.mode = TSPMoveMgr::NeighborGen;
+        } else if (option == "oropt") {
+            options.orOpt = 0.3;
+        } else if (option == "or3opt") {
+            options.threeOpt = 0.3;
+        } else if (option == "batch") {
+            options.batchSize = 64;
+        } else if (option == "huang") {
+            options.schedule = &huang;
+        } else if (option == "lam") {
+            options.schedule = &lam;
+        } else if (option == "sampled") {
+            options.sampled = true;
+        } else if (option.compare(0, 4, "csv=") == 0) {
+            options.recordFile = option.substr(4);
+            options.recordFormat = RecordWriter::Csv;
+        } else if (option.compare(0, 6, "jsonl=") == 0) {
+            options.recordFile = option.substr(6);
+            options.recordFormat = RecordWriter::JsonLines;
+        } else if (option.compare(0, 6, "cache=") == 0) {
+            options.cacheFile = option.substr(6);
+        } else if (option.compare(0, 5, "tour=") == 0) {
+            options.tourFile = option.substr(5);
+        } else if (option.compare(0, 6, "start=") == 0) {
+            options.startMethod = option.substr(6);
+        } else if (option == "warm") {
+            options.warmRatio = 0.1;
+        } else if (option.compare(0, 5, "warm=") == 0) {
+            options.warmRatio = atof(option.c_str() + 5);
+        } else if (option.compare(0, 5, "temp=") == 0) {
+            options.startTemp = atof(option.c_str() + 5);
+        } else if (option.compare(0, 11, "checkpoint=") == 0) {
+            options.checkpointFile = option.substr(11);
+        } else if (option.compare(0, 7, "resume=") == 0) {
+            options.resumeFile = option.substr(7);
+        } else if (option.compare(0, 5, "time=") == 0) {
+            options.timeBudget = atof(option.c_str() + 5);
+        } else if (option == "speculate") {
+            options.speculationThreads = 0;
+        } else if (option.compare(0, 10, "speculate=") == 0) {
+            options.speculationThreads = unsigned(atoi(option.c_str() + 10));
+        } else if (option == "multilevel") {
+            options.multilevel = true;
+        } else if (option == "decompose") {
+            options.decomposeRounds = 4;
+        } else if (option.compare(0, 10, "decompose=") == 0) {
+            options.decomposeRounds = atoi(option.c_str() + 10);
+        } else if (option == "polish") {
+            options.polish = true;
+        } else if (option == "nint") {
+            options.integerCosts = true;
+        }
+    }
 
-    std::cout << "Elapsed time = " << (float(clock() - start) / CLOCKS_PER_SEC) << "\n";
+    std::shared_ptr<TSPInstance> instance(new TSPInstance);
+    std::string error;
+    RecordWriter records(options.recordFormat);
+    if (!options.recordFile.empty() && !records.open(options.recordFile, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
 
-    return 0;
+    bool cached = false;
+    if (!options.cacheFile.empty()) {
+        cached = instance->loadCache(options.cacheFile, argv[1], error);
+        if (!cached) {
+            std::cerr << "Not using the cache: " << error << "\n";
+        }
+    }
+    if (!cached && !instance->load(argv[1], error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if (!options.cacheFile.empty() && !cached && !instance->saveCache(options.cacheFile, error)) {
+        std::cerr << error << "\n";
+    }
+    std::cerr << "Loaded " << instance->getName() << ": " << instance->getSize() << " cities, "
+              << (float(clock() - start) / CLOCKS_PER_SEC) << "s\n";
+    if (options.hilbert) {
+        instance->renumberHilbert();
+    }
+
+    std::vector<int> tour;
+    if (!options.tourFile.empty() && !instance->loadTour(options.tourFile, tour, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    if (tour.empty() && !options.startMethod.empty()) {
+        TSPConstruction::Method method;
+        if (options.startMethod == "nn") {
+            method = TSPConstruction::NearestNeighborTour;
+        } else if (options.startMethod == "greedy") {
+            method = TSPConstruction::GreedyTour;
+        } else if (options.startMethod == "sfc") {
+            method = TSPConstruction::SpaceFillingCurveTour;
+        } else if (options.startMethod == "savings") {
+            method = TSPConstruction::SavingsTour;
+        } else {
+            std::cerr << "unknown start method " << options.startMethod << "\n";
+            return 1;
+        }
+        const clock_t built = clock();
+        TSPConstruction::build(*instance, method, tour);
+        std::cerr << "Built a " << options.startMethod << " tour: "
+                  << (float(clock() - built) / CLOCKS_PER_SEC) << "s\n";
+    }
+
+    if (options.multilevel) {
+        TSPMultilevel multilevelAnnealer(instance);
+        multilevelAnnealer.setTourRep(options.rep);
+        multilevelAnnealer.setGenerateMode(options.mode);
+        multilevelAnnealer.setMoveMix(options.orOpt, options.threeOpt);
+        multilevelAnnealer.setTimeBudget(options.timeBudget);
+        multilevelAnnealer.setCancelToken(&interrupted);
+        signal(SIGINT, onInterrupt);
+        const bool annealed = multilevelAnnealer.optimize(tour, error);
+        signal(SIGINT, SIG_DFL);
+        if (!annealed) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+    if (options.decomposeRounds > 0) {
+        if (tour.empty() && instance->hasCoords()) {
+            TSPDecomposer::stripTour(*instance, tour);
+        } else if (tour.empty()) {
+            tour.resize(instance->getSize());
+            std::iota(tour.begin(), tour.end(), 0);
+        }
+        TSPDecomposer decomposer(instance);
+        decomposer.setRounds(options.decomposeRounds);
+        decomposer.setTourRep(options.rep);
+        decomposer.setGenerateMode(options.mode);
+        decomposer.setMoveMix(options.orOpt, options.threeOpt);
+        decomposer.setTimeBudget(options.timeBudget);
+        decomposer.setCancelToken(&interrupted);
+        signal(SIGINT, onInterrupt);
+        const bool decomposed = decomposer.optimize(tour, error);
+        signal(SIGINT, SIG_DFL);
+        if (!decomposed) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+
+    if (options.integerCosts) {
+        return annealTour<long long>(instance, tour, options, options.recordFile.empty() ? 0 : &records, start);
+    }
+    return annealTour<double>(instance, tour, options, options.recordFile.empty() ? 0 : &records, start);
 }